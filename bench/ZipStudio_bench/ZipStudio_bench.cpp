@@ -4,29 +4,195 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <chrono>
 
 #include <ziplab/basic/stddef.h>
 #include <ziplab/huffman/huffman.hpp>
+#include <ziplab/rans/rANSEncoder.h>
+#include <ziplab/rans/rANSDecoder.h>
+#include <ziplab/rans/rANSSimdEncoder.h>
+#include <ziplab/rans/rANSSimdDecoder.h>
+#include <ziplab/rans/rANSOrder1Encoder.h>
+#include <ziplab/rans/rANSOrder1Decoder.h>
+#include <ziplab/rans/rANSAdaptiveEncoder.h>
+#include <ziplab/rans/rANSAdaptiveDecoder.h>
+#include <ziplab/rans/tANSEncoder.h>
+#include <ziplab/rans/tANSDecoder.h>
+#include <ziplab/lz77/lzss.hpp>
 
 #if defined(_MSC_VER)
 #pragma comment(lib, "ZipStd.lib")
 #pragma comment(lib, "ZipLab.lib")
 #endif
 
-int main(int argc, char * argv[])
+static const int kBenchRepeats = 5;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start_time)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start_time;
+    return elapsed.count();
+}
+
+static std::string load_bench_data(const char * filename)
 {
-    ZIPLAB_UNUSED(argc);
-    ZIPLAB_UNUSED(argv);
+    std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+    if (ifs.is_open()) {
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        return ss.str();
+    }
+
+    // Fallback: 1 MB of skewed text
+    std::string data(1024 * 1024, ' ');
+    std::uint32_t seed = 2024;
+    for (std::size_t i = 0; i < data.size(); i++) {
+        seed = seed * 1103515245u + 12345u;
+        std::uint32_t rnd = (seed >> 16) % 100;
+        data[i] = (rnd < 40) ? 'e' : ((rnd < 65) ? 't' : ((rnd < 80) ? 'a' : static_cast<char>('b' + rnd % 24)));
+    }
+    return data;
+}
+
+template <typename Encoder, typename Decoder>
+void rans_bench_one(const char * name, const std::string & input_data)
+{
+    Encoder encoder;
+    Decoder decoder;
+    ziplab::MemoryBuffer compressed_data;
+    ziplab::MemoryBuffer decompressed_data;
+
+    double encode_ms = 0.0, decode_ms = 0.0;
+    int ret_val = 0;
+    for (int i = 0; i < kBenchRepeats; i++) {
+        compressed_data.seek_to_begin();
+        auto start_time = std::chrono::steady_clock::now();
+        ret_val |= encoder.compress(input_data, compressed_data);
+        encode_ms += elapsed_ms(start_time);
+
+        decompressed_data.seek_to_begin();
+        start_time = std::chrono::steady_clock::now();
+        ret_val |= decoder.decompress(compressed_data, decompressed_data);
+        decode_ms += elapsed_ms(start_time);
+    }
+
+    bool verified = (ret_val == 0) && (decompressed_data.size() == input_data.size()) &&
+                    (std::memcmp(decompressed_data.data(), input_data.data(), input_data.size()) == 0);
+    double total_mb = static_cast<double>(input_data.size()) * kBenchRepeats / (1024.0 * 1024.0);
+
+    printf("  %-28s %10u  %6.2f %%  %8.1f MB/s  %8.1f MB/s  %s\n", name,
+           static_cast<unsigned>(compressed_data.size()),
+           100.0 * compressed_data.size() / input_data.size(),
+           total_mb * 1000.0 / encode_ms, total_mb * 1000.0 / decode_ms,
+           verified ? "OK" : "FAILED");
+}
+
+//
+// Ratio and speed of the rANS variants: probability scale, state width,
+// renormalization unit, the number of interleaved states and the context order,
+// and of tANS against rANS at the same probability scale.
+//
+void rans_bench(const std::string & input_data)
+{
+    using namespace ziplab;
+
+    printf("rANS benchmark, input size: %u bytes\n\n", static_cast<unsigned>(input_data.size()));
+    printf("  %-28s %10s  %8s  %13s  %13s\n", "coder", "size", "ratio", "encode", "decode");
+
+    rans_bench_one<rANSEncoder64<char, 1, 16>, rANSDecoder64<char, 1, 16>>("rANS64 x1 scale 16", input_data);
+    rans_bench_one<rANSEncoder64<char, 4, 16>, rANSDecoder64<char, 4, 16>>("rANS64 x4 scale 16", input_data);
+    rans_bench_one<rANSEncoder64<char, 4, 14>, rANSDecoder64<char, 4, 14>>("rANS64 x4 scale 14", input_data);
+    rans_bench_one<rANSEncoder64<char, 4, 12>, rANSDecoder64<char, 4, 12>>("rANS64 x4 scale 12", input_data);
+    rans_bench_one<rANSEncoder64<char, 4, 10>, rANSDecoder64<char, 4, 10>>("rANS64 x4 scale 10", input_data);
+    rans_bench_one<rANSEncoder32<char, 1, 12>, rANSDecoder32<char, 1, 12>>("rANS32 byte x1 scale 12", input_data);
+    rans_bench_one<rANSEncoder32<char, 4, 12>, rANSDecoder32<char, 4, 12>>("rANS32 byte x4 scale 12", input_data);
+    rans_bench_one<rANSEncoder32<char, 4, 16>, rANSDecoder32<char, 4, 16>>("rANS32 byte x4 scale 16", input_data);
+    rans_bench_one<rANSSimdEncoder32<char, 32>, rANSSimdDecoder32<char, 32>>("rANS32 simd x32 scale 12", input_data);
+    rans_bench_one<rANSOrder1Encoder<char, 4, 12>, rANSOrder1Decoder<char, 4, 12>>("rANS64 order-1 x4 scale 12", input_data);
+    rans_bench_one<rANSAdaptiveEncoder<char, 2, 12>, rANSAdaptiveDecoder<char, 2, 12>>("rANS32 adaptive x2 scale 12", input_data);
+    rans_bench_one<rANSEncoder64<char, 4, 11>, rANSDecoder64<char, 4, 11>>("rANS64 x4 scale 11", input_data);
+    rans_bench_one<tANSEncoder<char, 2, 11>, tANSDecoder<char, 2, 11>>("tANS x2 table log 11", input_data);
+    rans_bench_one<tANSEncoder<char, 4, 11>, tANSDecoder<char, 4, 11>>("tANS x4 table log 11", input_data);
+    printf("\n");
+}
 
+template <typename Compressor>
+void lzss_bench_one(const char * name, int level, const std::string & input_data)
+{
+    Compressor compressor(level);
+    ziplab::MemoryBuffer compressed_data;
+    ziplab::MemoryBuffer decompressed_data;
+
+    double encode_ms = 0.0, decode_ms = 0.0;
+    int ret_val = 0;
+    for (int i = 0; i < kBenchRepeats; i++) {
+        compressed_data.seek_to_begin();
+        auto start_time = std::chrono::steady_clock::now();
+        ret_val |= compressor.plain_compress(input_data, compressed_data);
+        encode_ms += elapsed_ms(start_time);
+
+        decompressed_data.seek_to_begin();
+        start_time = std::chrono::steady_clock::now();
+        ret_val |= compressor.plain_decompress(compressed_data, decompressed_data);
+        decode_ms += elapsed_ms(start_time);
+    }
+
+    bool verified = (ret_val == 0) && (decompressed_data.size() == input_data.size()) &&
+                    (std::memcmp(decompressed_data.data(), input_data.data(), input_data.size()) == 0);
+    double total_mb = static_cast<double>(input_data.size()) * kBenchRepeats / (1024.0 * 1024.0);
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s level %d", name, level);
+    printf("  %-28s %10u  %6.2f %%  %8.1f MB/s  %8.1f MB/s  %s\n", label,
+           static_cast<unsigned>(compressed_data.size()),
+           100.0 * compressed_data.size() / input_data.size(),
+           total_mb * 1000.0 / encode_ms, total_mb * 1000.0 / decode_ms,
+           verified ? "OK" : "FAILED");
+}
+
+//
+// Ratio and speed of LZSS, for the window / length splits of the packed pair
+// and the compression levels.
+//
+void lzss_bench(const std::string & input_data)
+{
+    using namespace ziplab;
+
+    printf("LZSS benchmark, input size: %u bytes\n\n", static_cast<unsigned>(input_data.size()));
+    printf("  %-28s %10s  %8s  %13s  %13s\n", "compressor", "size", "ratio", "compress", "decompress");
+
+    static const int levels[] = { 1, 6, 9 };
+    for (int level : levels) {
+        lzss_bench_one<LZSSCompressor<12, 4>>("LZSS window 12 length 4", level, input_data);
+    }
+    for (int level : levels) {
+        lzss_bench_one<LZSSCompressor<13, 3>>("LZSS window 13 length 3", level, input_data);
+    }
+    printf("\n");
+}
+
+int main(int argc, char * argv[])
+{
     printf("Welcome to ZipStudio Client v1.0 .\n\n");
 
+    const char * filename = (argc > 1) ? argv[1] : "input.txt";
+
     ziplab::HuffmanCompressor huffman;
 
-    huffman.compressFile("input.txt", "compressed.bin");
+    huffman.compressFile(filename, "compressed.bin");
     huffman.decompressFile("compressed.bin", "decompressed.txt");
 
+    std::string input_data = load_bench_data(filename);
+    rans_bench(input_data);
+
+    // A small message, where the frequency table header matters
+    rans_bench(input_data.substr(0, 4096));
+
+    lzss_bench(input_data);
+
     return 0;
 }
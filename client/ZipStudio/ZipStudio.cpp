@@ -4,9 +4,13 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <iterator>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include <ziplab/stream/MemoryBuffer.h>
 #include <ziplab/stream/MemoryView.h>
@@ -25,6 +29,14 @@
 #include <ziplab/lz77/lzss.hpp>
 #include <ziplab/rans/rANSEncoder.h>
 #include <ziplab/rans/rANSDecoder.h>
+#include <ziplab/rans/rANSSimdEncoder.h>
+#include <ziplab/rans/rANSSimdDecoder.h>
+#include <ziplab/rans/rANSOrder1Encoder.h>
+#include <ziplab/rans/rANSOrder1Decoder.h>
+#include <ziplab/rans/rANSAdaptiveEncoder.h>
+#include <ziplab/rans/rANSAdaptiveDecoder.h>
+#include <ziplab/rans/tANSEncoder.h>
+#include <ziplab/rans/tANSDecoder.h>
 
 #include "dmc_test.h"
 
@@ -147,78 +159,389 @@ void ziplab_InputStream_test()
     }
 }
 
-void zipstd_huffman_test()
+//
+// A fixed pseudo-random generator (LCG) of the test inputs,
+// so the failures can be reproduced.
+//
+class TestRandom {
+public:
+    explicit TestRandom(std::uint32_t seed = 20250101u) : seed_(seed) {}
+
+    std::uint32_t next() {
+        seed_ = seed_ * 1103515245u + 12345u;
+        return (seed_ >> 16);
+    }
+
+private:
+    std::uint32_t seed_;
+};
+
+// Skewed text: a few frequent letters and some rare ones
+std::string make_skewed_text(TestRandom & random, std::size_t size)
 {
-    zipstd::HuffmanCompressor huffman;
+    static const char kAlphabet[] = "eeeeeeeetttttaaaaoooinnshrdlu \n.,;XQZ";
+    std::string text(size, '\0');
+    for (std::size_t n = 0; n < text.size(); n++) {
+        text[n] = kAlphabet[random.next() % (sizeof(kAlphabet) - 1)];
+    }
+    return text;
+}
 
-    huffman.compressFile("input.txt", "compressed_std.bin");
-    huffman.decompressFile("compressed_std.bin", "decompressed_std.txt");
+//
+// The truncated copies of a compressed data, cut by 1 byte and in half,
+// the decoders must reject them.
+//
+std::vector<std::string> make_truncated_data(const char * data, std::size_t size)
+{
+    std::vector<std::string> truncated;
+    if (size > 1) {
+        truncated.push_back(std::string(data, size - 1));
+        truncated.push_back(std::string(data, size / 2));
+    }
+    return truncated;
 }
 
-void ziplab_huffman_test()
+//
+// The inputs of the Huffman round trips: the sizes around kMinFourStreamSize,
+// where the data body is split into four streams, a single symbol, and a
+// skewed input whose code lengths must be limited.
+//
+std::vector<std::vector<unsigned char>> make_huffman_test_inputs()
 {
-    ziplab::HuffmanCompressor huffman;
+    typedef std::vector<unsigned char> ByteArray;
+    static const std::size_t kMinFourStreamSize = ziplab::HuffmanCompressor::kMinFourStreamSize;
+
+    std::vector<ByteArray> inputs;
+    inputs.push_back(ByteArray(1, 'A'));
+    inputs.push_back(ByteArray(1000, 'A'));
+
+    TestRandom random;
+    static const std::size_t sizes[] = {
+        kMinFourStreamSize - 1, kMinFourStreamSize, kMinFourStreamSize + 1, 4099
+    };
+    for (std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        std::string text = make_skewed_text(random, sizes[i]);
+        inputs.push_back(ByteArray(text.begin(), text.end()));
+    }
 
-    huffman.compressFile("input.txt", "compressed_lab.bin");
-    huffman.decompressFile("compressed_lab.bin", "decompressed_lab.txt");
+    // Symbol k appears with the probability 1/2^(k+1), the natural code lengths
+    // are longer than the default length limits.
+    ByteArray skewed(200000);
+    for (std::size_t n = 0; n < skewed.size(); n++) {
+        std::uint32_t bits = (random.next() << 16) | random.next();
+        std::uint32_t symbol = 0;
+        while (symbol < 31 && (bits & (1u << symbol)) == 0)
+            symbol++;
+        skewed[n] = static_cast<unsigned char>('A' + symbol);
+    }
+    inputs.push_back(skewed);
+
+    return inputs;
 }
 
-bool compare_buffer(const ziplab::MemoryBuffer & left, const std::string & right)
+// The data of the file round trips, larger than one kFileBlockSize (128 KB) block
+std::vector<unsigned char> make_huffman_test_file(const char * filename)
+{
+    TestRandom random;
+    std::vector<unsigned char> content(300 * 1024 + 7);
+    for (std::size_t n = 0; n < content.size(); n++) {
+        // The statistics change in each block
+        content[n] = static_cast<unsigned char>('a' + (n / 100000) * 4 + (random.next() % 7));
+    }
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(content.data()), static_cast<std::streamsize>(content.size()));
+    return content;
+}
+
+std::vector<unsigned char> read_file(const char * filename)
 {
-    ZIPLAB_UNUSED(left);
-    ZIPLAB_UNUSED(right);
-    return true;
+    std::ifstream file(filename, std::ios::binary);
+    return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 }
 
-void ziplab_lzss_test()
+template <typename Compressor>
+void huffman_test_one(const char * name)
 {
-    std::string input_data1 = "This is a simple example of LZ77 compression algorithm.";
-    std::string input_data2 = "ABABABAABABABACCDABABABABA";
+    typedef std::vector<unsigned char> ByteArray;
+
+    std::vector<ByteArray> inputs = make_huffman_test_inputs();
+    static const std::size_t max_code_lengths[] = {
+        Compressor::kMinCodeLength, Compressor::kDefaultCodeLength
+    };
+
+    std::size_t num_failed = 0;
+    for (std::size_t i = 0; i < sizeof(max_code_lengths) / sizeof(max_code_lengths[0]); i++) {
+        Compressor huffman(max_code_lengths[i]);
+        for (std::size_t n = 0; n < inputs.size(); n++) {
+            ByteArray compressed = huffman.compress(inputs[n]);
+            ByteArray decompressed = huffman.decompress(compressed);
+            if (decompressed != inputs[n]) {
+                printf("%s::decompress() is FAILED, input size = %u, max code length = %u.\n",
+                       name, static_cast<unsigned>(inputs[n].size()),
+                       static_cast<unsigned>(max_code_lengths[i]));
+                num_failed++;
+            }
+
+            // A rejected data decompresses to nothing
+            std::vector<std::string> truncated =
+                make_truncated_data(reinterpret_cast<const char *>(compressed.data()), compressed.size());
+            for (std::size_t t = 0; t < truncated.size(); t++) {
+                decompressed = huffman.decompress(ByteArray(truncated[t].begin(), truncated[t].end()));
+                if (!decompressed.empty()) {
+                    printf("%s::decompress() is FAILED, truncated to %u bytes, input size = %u, max code length = %u.\n",
+                           name, static_cast<unsigned>(truncated[t].size()),
+                           static_cast<unsigned>(inputs[n].size()),
+                           static_cast<unsigned>(max_code_lengths[i]));
+                    num_failed++;
+                }
+            }
+        }
+    }
 
-    std::string & input_data = input_data2;
+    Compressor huffman;
+    ByteArray content = make_huffman_test_file("huffman_input.bin");
+    if (!huffman.compressFile("huffman_input.bin", "huffman_compressed.bin") ||
+        !huffman.decompressFile("huffman_compressed.bin", "huffman_decompressed.bin") ||
+        (read_file("huffman_decompressed.bin") != content)) {
+        printf("%s::decompressFile() is FAILED, file size = %u.\n",
+               name, static_cast<unsigned>(content.size()));
+        num_failed++;
+    }
+    std::remove("huffman_input.bin");
+    std::remove("huffman_compressed.bin");
+    std::remove("huffman_decompressed.bin");
 
-    ziplab::LZSSCompressor<12, 4> lzss;
+    if (num_failed == 0) {
+        printf("%s::decompress() is PASSED.\n", name);
+    }
+}
 
-    int ret_val;
-    ziplab::MemoryBuffer compressed_data;
-    ret_val = lzss.plain_compress(input_data, compressed_data);
+void zipstd_huffman_test()
+{
+    huffman_test_one<zipstd::HuffmanCompressor>("zipstd::HuffmanCompressor");
+}
 
-    ziplab::MemoryBuffer decompressed_data;
-    if (ret_val == 0) {
-        ret_val = lzss.plain_decompress(compressed_data, decompressed_data);
+void ziplab_huffman_test()
+{
+    huffman_test_one<ziplab::HuffmanCompressor>("ziplab::HuffmanCompressor");
+    printf("\n");
+}
+
+bool compare_buffer(const ziplab::MemoryBuffer & left, const std::string & right)
+{
+    if (left.size() != right.size())
+        return false;
+    return (std::memcmp(left.data(), right.data(), right.size()) == 0);
+}
+
+//
+// The inputs of the LZSS round trips: the sizes around the 16 KB block and
+// the 4 KB window, and short periods, whose matches overlap their own output
+// (distances 1 to 7).
+//
+std::vector<std::string> make_lzss_test_inputs()
+{
+    std::vector<std::string> inputs;
+    inputs.push_back("");
+    inputs.push_back("A");
+    inputs.push_back("ABABABAABABABACCDABABABABA");
+
+    TestRandom random;
+
+    // Text made of a small set of words, with many matches
+    static const char * const kWords[] = {
+        "the ", "match ", "window ", "block ", "literal ", "length ", "distance ",
+        "of ", "and ", "a ", "LZSS ", "compress", "ion", "\n", "0123", ", "
+    };
+    static const std::size_t sizes[] = { 4095, 4096, 4097, 16383, 16384, 16385, 50000 };
+    for (std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        std::string input;
+        while (input.size() < sizes[i]) {
+            input += kWords[random.next() % (sizeof(kWords) / sizeof(kWords[0]))];
+            // Some noise, so the literals are mixed in
+            if ((random.next() % 8) == 0)
+                input.push_back(static_cast<char>(random.next() & 0xFF));
+        }
+        input.resize(sizes[i]);
+        inputs.push_back(input);
     }
 
-    if ((ret_val == 0) && compare_buffer(decompressed_data, input_data)) {
-        printf("ziplab::LZSSCompressor::decompress() is PASSED.\n\n");
-    } else {
-        printf("ziplab::LZSSCompressor::decompress() is FAILED.\n\n");
+    for (std::size_t period = 1; period <= 7; period++) {
+        std::string pattern;
+        for (std::size_t n = 0; n < period; n++) {
+            pattern.push_back(static_cast<char>('a' + random.next() % 26));
+        }
+        std::string input;
+        while (input.size() < 20000 + period) {
+            input += pattern;
+        }
+        input.resize(20000 + period);
+        inputs.push_back(input);
     }
+
+    return inputs;
 }
 
-void ziplab_rans_test()
+template <typename Compressor>
+void lzss_test_one(const char * name, const std::vector<std::string> & inputs)
 {
-    std::string input_data1 = "This is a simple example of rANS compression algorithm.";
-    std::string input_data2 = "ABABABAABABABACCDABABABABA";
+    static const int levels[] = { 1, 6, 9 };
+    static const int parsers[] = {
+        Compressor::kParseByLevel, Compressor::kParseGreedy,
+        Compressor::kParseLazy, Compressor::kParseOptimal
+    };
+    static const char * const parser_names[] = { "level", "greedy", "lazy", "optimal" };
+
+    for (std::size_t i = 0; i < sizeof(parsers) / sizeof(parsers[0]); i++) {
+        std::size_t num_failed = 0;
+        for (std::size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            Compressor lzss(levels[l], parsers[i]);
+            for (std::size_t n = 0; n < inputs.size(); n++) {
+                const std::string & input_data = inputs[n];
+
+                int ret_val;
+                ziplab::MemoryBuffer compressed_data;
+                ret_val = lzss.plain_compress(input_data, compressed_data);
+
+                ziplab::MemoryBuffer decompressed_data;
+                if (ret_val == 0) {
+                    ret_val = lzss.plain_decompress(compressed_data, decompressed_data);
+                }
+
+                if ((ret_val != 0) || !compare_buffer(decompressed_data, input_data)) {
+                    printf("ziplab::%s::decompress() is FAILED, parser = %s, level = %d, input size = %u.\n",
+                           name, parser_names[i], levels[l], static_cast<unsigned>(input_data.size()));
+                    num_failed++;
+                }
+
+                std::vector<std::string> truncated =
+                    make_truncated_data(compressed_data.data(), compressed_data.size());
+                for (std::size_t t = 0; t < truncated.size(); t++) {
+                    ziplab::MemoryBuffer truncated_data, output_data;
+                    truncated_data.copy(truncated[t]);
+                    if (lzss.plain_decompress(truncated_data, output_data) == 0) {
+                        printf("ziplab::%s::decompress() is FAILED, truncated to %u bytes, parser = %s, level = %d, input size = %u.\n",
+                               name, static_cast<unsigned>(truncated[t].size()), parser_names[i], levels[l],
+                               static_cast<unsigned>(input_data.size()));
+                        num_failed++;
+                    }
+                }
+            }
+        }
+
+        if (num_failed == 0) {
+            printf("ziplab::%s::decompress() is PASSED, parser = %s.\n", name, parser_names[i]);
+        }
+    }
+}
 
-    std::string & input_data = input_data2;
+void ziplab_lzss_test()
+{
+    std::vector<std::string> inputs = make_lzss_test_inputs();
 
-    ziplab::rANSEncoder64<char> rANSEnocoder;
+    lzss_test_one<ziplab::LZSSCompressor<12, 4>>("LZSSCompressor<12, 4>", inputs);
+    lzss_test_one<ziplab::LZSSCompressor<13, 3>>("LZSSCompressor<13, 3>", inputs);
+    printf("\n");
+}
 
-    int ret_val;
-    ziplab::MemoryBuffer compressed_data;
-    ret_val = rANSEnocoder.compress(input_data, compressed_data);
+//
+// The inputs of the entropy coder round trips: the empty and 1-byte cases,
+// the sizes around a group of the 32 lanes of rANSSimdDecoder32, and inputs
+// which span several rescale intervals of the adaptive model (16 to 1024).
+//
+std::vector<std::string> make_rans_test_inputs()
+{
+    std::vector<std::string> inputs;
+    inputs.push_back("");
+    inputs.push_back("A");
+    inputs.push_back("ABABABAABABABACCDABABABABA");
+    inputs.push_back("This is a simple example of rANS compression algorithm.");
+
+    TestRandom random;
+    static const std::size_t sizes[] = { 31, 32, 33, 255, 256, 257, 1023, 1024, 1025, 4097, 65536 + 7 };
+    for (std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        inputs.push_back(make_skewed_text(random, sizes[i]));
+    }
+
+    // All the 256 byte values
+    std::string binary(20000, '\0');
+    for (std::size_t n = 0; n < binary.size(); n++) {
+        binary[n] = static_cast<char>(random.next() & 0xFF);
+    }
+    inputs.push_back(binary);
 
-    ziplab::MemoryBuffer decompressed_data;
-    if (ret_val == 0) {
-        ziplab::rANSDecoder64<char> rANSDecoder;
-        ret_val = rANSDecoder.decompress(compressed_data, decompressed_data);
+    // The statistics change along the input, for the adaptive model
+    std::string drifting(20000, '\0');
+    for (std::size_t n = 0; n < drifting.size(); n++) {
+        drifting[n] = static_cast<char>('a' + (n / 2500) * 2 + (random.next() % 3));
     }
+    inputs.push_back(drifting);
 
-    if ((ret_val == 0) && compare_buffer(decompressed_data, input_data)) {
-        printf("ziplab::rANSDecoder64::decompress() is PASSED.\n\n");
-    } else {
-        printf("ziplab::rANSDecoder64::decompress() is FAILED.\n\n");
+    return inputs;
+}
+
+template <typename Encoder, typename Decoder>
+void rans_test_one(const char * name, const std::vector<std::string> & inputs)
+{
+    Encoder encoder;
+    Decoder decoder;
+
+    std::size_t num_passed = 0, num_failed = 0;
+    for (std::size_t i = 0; i < inputs.size(); i++) {
+        const std::string & input_data = inputs[i];
+
+        int ret_val;
+        ziplab::MemoryBuffer compressed_data;
+        ret_val = encoder.compress(input_data, compressed_data);
+
+        ziplab::MemoryBuffer decompressed_data;
+        if (ret_val == 0) {
+            ret_val = decoder.decompress(compressed_data, decompressed_data);
+        }
+
+        if ((ret_val == 0) && compare_buffer(decompressed_data, input_data)) {
+            num_passed++;
+        } else {
+            printf("ziplab::%s::decompress() is FAILED, input size = %u.\n",
+                   name, static_cast<unsigned>(input_data.size()));
+        }
+
+        std::vector<std::string> truncated = make_truncated_data(compressed_data.data(), compressed_data.size());
+        for (std::size_t t = 0; t < truncated.size(); t++) {
+            ziplab::MemoryBuffer truncated_data, output_data;
+            truncated_data.copy(truncated[t]);
+            if (decoder.decompress(truncated_data, output_data) == 0) {
+                printf("ziplab::%s::decompress() is FAILED, truncated to %u bytes, input size = %u.\n",
+                       name, static_cast<unsigned>(truncated[t].size()), static_cast<unsigned>(input_data.size()));
+                num_failed++;
+            }
+        }
     }
+
+    if ((num_passed == inputs.size()) && (num_failed == 0)) {
+        printf("ziplab::%s::decompress() is PASSED, %u inputs.\n",
+               name, static_cast<unsigned>(inputs.size()));
+    }
+}
+
+void ziplab_rans_test()
+{
+    using namespace ziplab;
+
+    std::vector<std::string> inputs = make_rans_test_inputs();
+
+    rans_test_one<rANSEncoder64<char>, rANSDecoder64<char>>("rANSDecoder64<char>", inputs);
+    rans_test_one<rANSEncoder64<char, 4>, rANSDecoder64<char, 4>>("rANSDecoder64<char, 4>", inputs);
+    rans_test_one<rANSEncoder32<char, 4, 12>, rANSDecoder32<char, 4, 12>>("rANSDecoder32<char, 4, 12>", inputs);
+    rans_test_one<rANSSimdEncoder32<char, 32>, rANSSimdDecoder32<char, 32>>("rANSSimdDecoder32<char, 32>", inputs);
+    rans_test_one<rANSSimdEncoder32<char, 8>, rANSSimdDecoder32<char, 8>>("rANSSimdDecoder32<char, 8>", inputs);
+    rans_test_one<rANSOrder1Encoder<char>, rANSOrder1Decoder<char>>("rANSOrder1Decoder<char>", inputs);
+    rans_test_one<rANSAdaptiveEncoder<char>, rANSAdaptiveDecoder<char>>("rANSAdaptiveDecoder<char>", inputs);
+    rans_test_one<rANSAdaptiveEncoder<char, 4>, rANSAdaptiveDecoder<char, 4>>("rANSAdaptiveDecoder<char, 4>", inputs);
+    rans_test_one<tANSEncoder<char>, tANSDecoder<char>>("tANSDecoder<char>", inputs);
+    rans_test_one<tANSEncoder<char, 4, 11>, tANSDecoder<char, 4, 11>>("tANSDecoder<char, 4, 11>", inputs);
+    printf("\n");
 }
 
 // Example usage
@@ -270,8 +593,8 @@ int main(int argc, char * argv[])
 
     //dynamic_markov_compression_test();
 
-    //zipstd_huffman_test();
-    //ziplab_huffman_test();
+    zipstd_huffman_test();
+    ziplab_huffman_test();
 
     ziplab_lzss_test();
     ziplab_rans_test();
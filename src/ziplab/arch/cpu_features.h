@@ -0,0 +1,72 @@
+#ifndef ZIPLAB_ARCH_CPU_FEATURES_H
+#define ZIPLAB_ARCH_CPU_FEATURES_H
+
+#pragma once
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>     // For __cpuid(), __cpuidex(), _xgetbv()
+#endif
+
+//
+// ZIPLAB_TARGET_AVX2 marks a function which is compiled with AVX2 enabled,
+// even if the translation unit isn't, the caller must check cpu_has_avx2()
+// at runtime before calling it.
+//
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ZIPLAB_TARGET_AVX2          __attribute__((target("avx2")))
+#define ZIPLAB_CAN_TARGET_AVX2      1
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define ZIPLAB_TARGET_AVX2
+#define ZIPLAB_CAN_TARGET_AVX2      1
+#else
+#define ZIPLAB_TARGET_AVX2
+#endif
+
+#if defined(ZIPLAB_CAN_TARGET_AVX2)
+#include <immintrin.h>
+#endif
+
+namespace ziplab {
+
+namespace detail {
+
+static inline bool detect_cpu_avx2()
+{
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return (__builtin_cpu_supports("avx2") != 0);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return false;
+
+    // OSXSAVE and AVX
+    __cpuid(regs, 1);
+    static const int kOSXSaveAndAVX = (1 << 27) | (1 << 28);
+    if ((regs[2] & kOSXSaveAndAVX) != kOSXSaveAndAVX)
+        return false;
+
+    // The OS saves the XMM and YMM registers
+    if ((_xgetbv(0) & 0x06) != 0x06)
+        return false;
+
+    __cpuidex(regs, 7, 0);
+    return ((regs[1] & (1 << 5)) != 0);
+#else
+    return false;
+#endif
+}
+
+} // namespace detail
+
+// Whether the running CPU supports AVX2, detected once.
+static inline bool cpu_has_avx2()
+{
+    static const bool has_avx2 = detail::detect_cpu_avx2();
+    return has_avx2;
+}
+
+} // namespace ziplab
+
+#endif // ZIPLAB_ARCH_CPU_FEATURES_H
@@ -0,0 +1,96 @@
+#ifndef ZIPLAB_ENTROPY_HISTOGRAM_HPP
+#define ZIPLAB_ENTROPY_HISTOGRAM_HPP
+
+#pragma once
+
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>      // For std::memcpy(), std::memset()
+
+#include "ziplab/basic/stddef.h"
+
+namespace ziplab {
+
+//
+// Byte histogram shared by the entropy coders (Huffman, rANS, tANS).
+//
+// A single counter table serializes on the store-to-load dependency when the
+// same byte repeats, so the bytes are spread over several interleaved counter
+// tables and the tables are summed at the end. AVX2 has no scatter-add, a
+// vector load which is split into the same counter tables runs no faster.
+//
+static constexpr std::size_t kHistogramSymbols = 256;
+
+namespace detail {
+
+static ZIPLAB_FORCED_INLINE
+std::uint64_t histogram_load_u64(const std::uint8_t * ptr)
+{
+    std::uint64_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+template <std::size_t NumTables>
+static inline
+void histogram_merge(const std::uint32_t (&counts)[NumTables][kHistogramSymbols],
+                     std::uint32_t * freqs)
+{
+    for (std::size_t symbol = 0; symbol < kHistogramSymbols; symbol++) {
+        std::uint32_t freq = 0;
+        for (std::size_t n = 0; n < NumTables; n++) {
+            freq += counts[n][symbol];
+        }
+        freqs[symbol] = freq;
+    }
+}
+
+} // namespace detail
+
+// 4 counter tables, 16 bytes per iteration.
+static inline
+void count_histogram_scalar(const void * data, std::size_t size, std::uint32_t * freqs)
+{
+    const std::uint8_t * src = static_cast<const std::uint8_t *>(data);
+    const std::uint8_t * end = src + size;
+
+    std::uint32_t counts[4][kHistogramSymbols];
+    std::memset(counts, 0, sizeof(counts));
+
+    if (size >= 16) {
+        const std::uint8_t * limit = end - 16;
+        while (src <= limit) {
+            std::uint64_t lo = detail::histogram_load_u64(src);
+            std::uint64_t hi = detail::histogram_load_u64(src + 8);
+            for (std::size_t i = 0; i < 8; i += 2) {
+                counts[0][(lo >> (i * 8 + 0)) & 0xFF]++;
+                counts[1][(lo >> (i * 8 + 8)) & 0xFF]++;
+                counts[2][(hi >> (i * 8 + 0)) & 0xFF]++;
+                counts[3][(hi >> (i * 8 + 8)) & 0xFF]++;
+            }
+            src += 16;
+        }
+    }
+
+    while (src < end) {
+        counts[0][*src++]++;
+    }
+
+    detail::histogram_merge(counts, freqs);
+}
+
+//
+// Count the frequency of each byte value, freqs[] must have kHistogramSymbols entries.
+//
+static inline
+void count_histogram(const void * data, std::size_t size, std::uint32_t * freqs)
+{
+    assert(freqs != nullptr);
+    count_histogram_scalar(data, size, freqs);
+}
+
+} // namespace ziplab
+
+#endif // ZIPLAB_ENTROPY_HISTOGRAM_HPP
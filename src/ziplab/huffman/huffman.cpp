@@ -4,110 +4,396 @@
 #include <sstream>
 #include <string>
 #include <vector>
-#include <queue>
-#include <bitset>
 #include <algorithm>
 
+#include <assert.h>
+
+#include "ziplab/basic/stddef.h"
 #include "ziplab/huffman/huffman.hpp"
+#include "ziplab/stream/BitReader.h"
+#include "ziplab/stream/BitWriter.h"
+#include "ziplab/stream/FileReader.h"
+#include "ziplab/stream/FileWriter.h"
+#include "ziplab/entropy/Histogram.h"
 
 namespace ziplab {
 
+void HuffmanCompressor::buildHistogram(const HuffmanByte * data, std::size_t size, Histogram & histogram)
+{
+    static_assert(kMaxSymbols == kHistogramSymbols,
+                  "kMaxSymbols must be equal to kHistogramSymbols");
+    count_histogram(data, size, histogram.data());
+}
+
+//
+// Sort the used symbols by frequency with LSD radix sort, 8 bits per pass,
+// the passes of the high bytes that are all zero are skipped. The sort is stable,
+// so the symbols of the same frequency are kept in ascending order.
+//
+static std::size_t sortSymbolsByFreq(const HuffmanCompressor::Histogram & histogram, std::uint8_t * symbols)
+{
+    std::size_t num_symbols = 0;
+    std::uint32_t all_freqs = 0;
+    for (std::size_t symbol = 0; symbol < HuffmanCompressor::kMaxSymbols; symbol++) {
+        std::uint32_t freq = histogram[symbol];
+        if (freq != 0) {
+            symbols[num_symbols++] = static_cast<std::uint8_t>(symbol);
+            all_freqs |= freq;
+        }
+    }
+
+    std::uint8_t buffer[HuffmanCompressor::kMaxSymbols];
+    std::uint8_t * src = symbols;
+    std::uint8_t * dest = buffer;
+    for (std::size_t shift = 0; shift < 32 && (all_freqs >> shift) != 0; shift += 8) {
+        std::uint32_t offsets[256 + 1] = { 0 };
+        for (std::size_t i = 0; i < num_symbols; i++) {
+            offsets[((histogram[src[i]] >> shift) & 0xFF) + 1]++;
+        }
+        for (std::size_t digit = 0; digit < 256; digit++) {
+            offsets[digit + 1] += offsets[digit];
+        }
+        for (std::size_t i = 0; i < num_symbols; i++) {
+            dest[offsets[(histogram[src[i]] >> shift) & 0xFF]++] = src[i];
+        }
+        std::swap(src, dest);
+    }
+
+    if (src != symbols) {
+        std::copy(src, src + num_symbols, symbols);
+    }
+    return num_symbols;
+}
+
 HuffmanNode *
-HuffmanCompressor::buildHuffmanTree(const FreqMap & freqMap)
+HuffmanCompressor::buildHuffmanTree(const Histogram & histogram)
 {
-    // Create priority queue
-    HuffmanCompare comp;
-    std::priority_queue<HuffmanNode *,
-                        std::vector<HuffmanNode *>,
-                        decltype(comp)> pq(comp);
+    // All the nodes of the previous tree are released
+    node_count_ = 0;
+
+    std::uint8_t symbols[kMaxSymbols];
+    std::size_t num_leaves = sortSymbolsByFreq(histogram, symbols);
+    if (num_leaves == 0) return nullptr;
 
-    // Add all characters to queue
-    for (const auto & iter : freqMap) {
-        pq.push(new HuffmanNode(iter.first, iter.second));
+    // The first queue: the leaves sorted by frequency
+    for (std::size_t i = 0; i < num_leaves; i++) {
+        newNode(symbols[i], histogram[symbols[i]]);
     }
 
-    // Build Huffman tree
-    while (pq.size() >= 2) {
-        auto left = pq.top(); pq.pop();
-        auto right = pq.top(); pq.pop();
+    //
+    // The second queue: the internal nodes, they are created in non-decreasing
+    // order of frequency, so the two smallest nodes are always at the front of
+    // the two queues.
+    //
+    HuffmanNode * nodes = node_pool_.data();
+    std::size_t leaf = 0;
+    std::size_t internal = num_leaves;
+    for (std::size_t n = 1; n < num_leaves; n++) {
+        HuffmanNode * children[2];
+        for (std::size_t k = 0; k < 2; k++) {
+            if ((leaf < num_leaves) &&
+                ((internal >= node_count_) || (nodes[leaf].freq <= nodes[internal].freq)))
+                children[k] = &nodes[leaf++];
+            else
+                children[k] = &nodes[internal++];
+        }
 
-        auto parent = new HuffmanNode('\0', left->freq + right->freq);
-        parent->left = left;
-        parent->right = right;
-        pq.push(parent);
+        auto parent = newNode('\0', children[0]->freq + children[1]->freq);
+        parent->left = children[0];
+        parent->right = children[1];
     }
 
-    return (pq.empty() ? nullptr : pq.top());
+    return &nodes[node_count_ - 1];
 }
 
 HuffmanNode *
-HuffmanCompressor::buildHuffmanTree(const std::vector<HuffmanByte> & data)
+HuffmanCompressor::buildHuffmanTree(const HuffmanByte * data, std::size_t size)
 {
     // Calculate frequencies
-    FreqMap freqMap;
-    for (HuffmanByte c : data) {
-        freqMap[c]++;
-    }
+    Histogram histogram;
+    buildHistogram(data, size, histogram);
 
-    return buildHuffmanTree(freqMap);
+    return buildHuffmanTree(histogram);
 }
 
-void HuffmanCompressor::generateHuffmanCodes(HuffmanNode * node,
-                                             const std::string & code,
-                                             CodeMap & codes)
+std::size_t HuffmanCompressor::generateCodeLengths(HuffmanNode * node, std::size_t depth,
+                                                   CodeLengths & lengths)
 {
-    if (!node) return;
+    if (!node) return 0;
 
     if (!node->left && !node->right) {
-        codes[node->data] = code;
+        // A lone symbol also uses a 1 bit code
+        std::size_t length = (depth > 0) ? depth : 1;
+        lengths[node->data] = static_cast<std::uint8_t>(length);
+        return length;
+    }
+
+    std::size_t left_length  = generateCodeLengths(node->left,  depth + 1, lengths);
+    std::size_t right_length = generateCodeLengths(node->right, depth + 1, lengths);
+    return (std::max)(left_length, right_length);
+}
+
+std::size_t HuffmanCompressor::buildCodeLengths(HuffmanNode * root, CodeLengths & lengths)
+{
+    lengths.fill(0);
+    std::size_t max_length = generateCodeLengths(root, 0, lengths);
+
+    if (ziplab_unlikely(max_length > max_code_length_)) {
+        // The codes are too long, rebuild the code lengths with the length limit.
+        std::size_t num_leaves = (node_count_ + 1) / 2;
+        buildLimitedCodeLengths(node_pool_.data(), num_leaves, max_code_length_, lengths);
+
+        max_length = 0;
+        for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+            if (lengths[symbol] > max_length)
+                max_length = lengths[symbol];
+        }
+    }
+    return max_length;
+}
+
+//
+// Package-merge algorithm (Larmore and Hirschberg).
+//
+// lists[0] is the leaves sorted by frequency, lists[i] is the leaves merged with
+// the packages of each two adjacent items in lists[i - 1]. Select the first 2n - 2
+// items of the last list, then the first (2 * packages) items of the previous list,
+// and so on. The code length of a symbol is the number of times its leaf is selected.
+//
+void HuffmanCompressor::buildLimitedCodeLengths(const HuffmanNode * leaves, std::size_t num_leaves,
+                                                std::size_t max_length, CodeLengths & lengths)
+{
+    struct PackageItem {
+        std::uint64_t weight;
+        std::int32_t  symbol;   // -1 is a package of two items in the previous list
+    };
+
+    // The leaves are sorted by frequency
+    std::vector<PackageItem> items(num_leaves);
+    for (std::size_t i = 0; i < num_leaves; i++) {
+        items[i].weight = leaves[i].freq;
+        items[i].symbol = static_cast<std::int32_t>(leaves[i].data);
+    }
+
+    lengths.fill(0);
+
+    if (num_leaves <= 2) {
+        for (const auto & item : items) {
+            lengths[item.symbol] = 1;
+        }
         return;
     }
+    assert(max_length <= kMaxCodeLength);
+    assert((static_cast<std::uint64_t>(1) << max_length) >= num_leaves);
+
+    std::vector<std::vector<PackageItem>> lists(max_length);
+    lists[0] = items;
+    for (std::size_t level = 1; level < max_length; level++) {
+        const std::vector<PackageItem> & prev = lists[level - 1];
+        std::vector<PackageItem> & list = lists[level];
+        std::size_t num_packages = prev.size() / 2;
+        list.reserve(num_leaves + num_packages);
+
+        std::size_t i = 0, j = 0;
+        while (i < num_leaves || j < num_packages) {
+            if (j < num_packages) {
+                std::uint64_t weight = prev[j * 2].weight + prev[j * 2 + 1].weight;
+                if (i >= num_leaves || weight < items[i].weight) {
+                    list.push_back({ weight, -1 });
+                    j++;
+                    continue;
+                }
+            }
+            list.push_back(items[i++]);
+        }
+    }
 
-    generateHuffmanCodes(node->left,  code + "0", codes);
-    generateHuffmanCodes(node->right, code + "1", codes);
+    std::size_t num_items = num_leaves * 2 - 2;
+    for (std::size_t level = max_length; level-- > 0; ) {
+        const std::vector<PackageItem> & list = lists[level];
+        assert(num_items <= list.size());
+        std::size_t num_packages = 0;
+        for (std::size_t i = 0; i < num_items; i++) {
+            if (list[i].symbol >= 0)
+                lengths[list[i].symbol]++;
+            else
+                num_packages++;
+        }
+        num_items = num_packages * 2;
+    }
 }
 
-std::vector<HuffmanByte>
-HuffmanCompressor::serializeTree(HuffmanNode * root)
+void HuffmanCompressor::assignCanonicalCodes(const CodeLengths & lengths, CodeTable & codes)
 {
-    std::vector<HuffmanByte> result;
+    // Count the number of codes for each code length
+    std::uint32_t length_count[kMaxCodeLength + 1] = { 0 };
+    for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+        assert(lengths[symbol] <= kMaxCodeLength);
+        length_count[lengths[symbol]]++;
+    }
+    length_count[0] = 0;
+
+    // The first code of each code length
+    std::uint64_t next_code[kMaxCodeLength + 1];
+    std::uint64_t code = 0;
+    next_code[0] = 0;
+    for (std::size_t length = 1; length <= kMaxCodeLength; length++) {
+        code = (code + length_count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+
+    // Assign codes in the order of symbols for each code length
+    for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+        std::size_t length = lengths[symbol];
+        if (length != 0) {
+            codes[symbol].code = static_cast<std::uint32_t>(next_code[length]++);
+            codes[symbol].length = static_cast<std::uint32_t>(length);
+        } else {
+            codes[symbol].code = 0;
+            codes[symbol].length = 0;
+        }
+    }
+}
+
+//
+// The code lengths header:
+//
+// [min_symbol: 1 byte][max_symbol: 1 byte][max_length: 1 byte]
+// [the code lengths of symbols in range [min_symbol, max_symbol]]
+//
+// The code lengths are packed into 4 bits (low nibble first) if max_length <= 15,
+// otherwise each code length uses 1 byte.
+//
+void HuffmanCompressor::writeCodeLengths(const CodeLengths & lengths, MemoryBuffer & output)
+{
+    std::size_t min_symbol = kMaxSymbols;
+    std::size_t max_symbol = 0;
+    std::size_t max_length = 0;
+    for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+        std::size_t length = lengths[symbol];
+        if (length != 0) {
+            if (symbol < min_symbol)
+                min_symbol = symbol;
+            max_symbol = symbol;
+            if (length > max_length)
+                max_length = length;
+        }
+    }
+    assert(min_symbol <= max_symbol);
+
+    output.write(static_cast<char>(min_symbol));
+    output.write(static_cast<char>(max_symbol));
+    output.write(static_cast<char>(max_length));
+
+    if (max_length <= 15) {
+        for (std::size_t symbol = min_symbol; symbol <= max_symbol; symbol += 2) {
+            std::uint8_t low  = lengths[symbol];
+            std::uint8_t high = (symbol < max_symbol) ? lengths[symbol + 1] : 0;
+            output.write(static_cast<char>(low | (high << 4)));
+        }
+    } else {
+        output.write(reinterpret_cast<const char *>(lengths.data() + min_symbol),
+                     max_symbol - min_symbol + 1);
+    }
+}
+
+std::size_t HuffmanCompressor::readCodeLengths(const HuffmanByte * input, std::size_t size, std::size_t & pos,
+                                               CodeLengths & lengths)
+{
+    if ((pos + 3) > size) return 0;
+
+    std::size_t min_symbol = input[pos++];
+    std::size_t max_symbol = input[pos++];
+    std::size_t max_length = input[pos++];
+    if ((min_symbol > max_symbol) || (max_length == 0) || (max_length > kMaxCodeLength)) {
+        return 0;
+    }
 
-    if (!root) return result;
+    std::size_t num_symbols = max_symbol - min_symbol + 1;
+    std::size_t header_size = (max_length <= 15) ? ((num_symbols + 1) / 2) : num_symbols;
+    if ((pos + header_size) > size) return 0;
 
-    // Use preorder traversal to serialize the tree
-    if ((root->left == nullptr) && (root->right == nullptr)) {
-        result.push_back(1);  // Leaf node marker
-        result.push_back(root->data);
+    lengths.fill(0);
+    if (max_length <= 15) {
+        for (std::size_t i = 0; i < num_symbols; i++) {
+            HuffmanByte packed = input[pos + i / 2];
+            lengths[min_symbol + i] = static_cast<std::uint8_t>((i & 1) ? (packed >> 4) : (packed & 0x0F));
+        }
     } else {
-        result.push_back(0);  // Internal node marker
-        auto left_ser  = serializeTree(root->left);
-        auto right_ser = serializeTree(root->right);
-        result.insert(result.end(), left_ser.begin(),  left_ser.end());
-        result.insert(result.end(), right_ser.begin(), right_ser.end());
+        for (std::size_t i = 0; i < num_symbols; i++) {
+            lengths[min_symbol + i] = input[pos + i];
+        }
     }
+    pos += header_size;
 
-    return result;
+    for (std::size_t symbol = min_symbol; symbol <= max_symbol; symbol++) {
+        if (lengths[symbol] > max_length) return 0;
+    }
+    return max_length;
 }
 
-HuffmanNode *
-HuffmanCompressor::deserializeTree(const std::vector<HuffmanByte> & tree_data, std::size_t & index) {
-    if (index >= tree_data.size()) {
-        return nullptr;
-    }
-
-    if (tree_data[index] == 1) {  // Leaf node
-        index++;
-        if (index >= tree_data.size())
-            return nullptr;
-        auto node = new HuffmanNode(tree_data[index], 0);
-        index++;
-        return node;
-    } else {  // Internal node
-        index++;
-        auto node = new HuffmanNode('\0', 0);
-        node->left  = deserializeTree(tree_data, index);
-        node->right = deserializeTree(tree_data, index);
-        return node;
+std::size_t HuffmanCompressor::buildDecodeTable(const CodeLengths & lengths, const CodeTable & codes,
+                                                std::size_t max_length, DecodeTable & table)
+{
+    std::size_t table_bits = (std::min)(kDecodeTableBits, max_length);
+    assert(table_bits > 0);
+
+    table.assign(static_cast<std::size_t>(1) << table_bits, 0);
+
+    fillDecodeTable(lengths, codes, 0, 0, 0, table_bits, table);
+    return table_bits;
+}
+
+void HuffmanCompressor::fillDecodeTable(const CodeLengths & lengths, const CodeTable & codes,
+                                        std::uint64_t prefix, std::size_t prefix_len,
+                                        std::size_t table_base, std::size_t table_bits,
+                                        DecodeTable & table)
+{
+    // The max code length (minus the table bits) of codes that overflow each entry
+    std::uint8_t sub_lengths[static_cast<std::size_t>(1) << kDecodeTableBits];
+    std::size_t table_size = static_cast<std::size_t>(1) << table_bits;
+    std::fill(sub_lengths, sub_lengths + table_size, 0);
+
+    for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+        std::size_t length = lengths[symbol];
+        if (length <= prefix_len) continue;
+
+        std::size_t rest_len = length - prefix_len;
+        std::uint64_t code = codes[symbol].code;
+        if ((code >> rest_len) != prefix) continue;
+        code &= (static_cast<std::uint64_t>(1) << rest_len) - 1;
+
+        if (rest_len <= table_bits) {
+            // Fill all the entries that start with this code
+            std::size_t shift = table_bits - rest_len;
+            std::size_t first = table_base + static_cast<std::size_t>(code << shift);
+            std::size_t last  = first + (static_cast<std::size_t>(1) << shift);
+            std::uint32_t entry = (static_cast<std::uint32_t>(symbol) << 8) |
+                                   static_cast<std::uint32_t>(rest_len);
+            std::fill(table.begin() + first, table.begin() + last, entry);
+        } else {
+            // The code is longer than this level, it will be resolved by a sub table
+            std::size_t index = static_cast<std::size_t>(code >> (rest_len - table_bits));
+            std::uint8_t sub_len = static_cast<std::uint8_t>(rest_len - table_bits);
+            if (sub_len > sub_lengths[index])
+                sub_lengths[index] = sub_len;
+        }
+    }
+
+    for (std::size_t index = 0; index < table_size; index++) {
+        if (sub_lengths[index] == 0) continue;
+
+        std::size_t sub_bits = (std::min)(kDecodeTableBits, static_cast<std::size_t>(sub_lengths[index]));
+        std::size_t sub_base = table.size();
+        assert((sub_base << 8) <= kDecodeValueMask);
+        table.resize(sub_base + (static_cast<std::size_t>(1) << sub_bits), 0);
+
+        table[table_base + index] = kDecodeLinkFlag |
+                                    static_cast<std::uint32_t>(sub_base << 8) |
+                                    static_cast<std::uint32_t>(sub_bits);
+
+        fillDecodeTable(lengths, codes, (prefix << table_bits) | index, prefix_len + table_bits,
+                        sub_base, sub_bits, table);
     }
 }
 
@@ -116,206 +402,469 @@ HuffmanCompressor::compress(const std::vector<HuffmanByte> & data)
 {
     if (data.empty()) return {};
 
+    MemoryBuffer output;
+    compress(data.data(), data.size(), output);
+
+    const HuffmanByte * compressed = reinterpret_cast<const HuffmanByte *>(output.data());
+    return std::vector<HuffmanByte>(compressed, compressed + output.size());
+}
+
+static inline void writeUInt32(MemoryBuffer & output, std::size_t pos, std::uint32_t value)
+{
+    char * ptr = output.data() + pos;
+    for (std::size_t i = 0; i < sizeof(std::uint32_t); ++i) {
+        ptr[i] = static_cast<char>((value >> (i * 8)) & 0xFF);
+    }
+}
+
+static inline std::uint32_t readUInt32(const HuffmanByte * input)
+{
+    std::uint32_t value = 0;
+    for (std::size_t i = 0; i < sizeof(std::uint32_t); ++i) {
+        value |= static_cast<std::uint32_t>(input[i]) << (i * 8);
+    }
+    return value;
+}
+
+void HuffmanCompressor::compress(const HuffmanByte * data, std::size_t size, MemoryBuffer & output)
+{
+    if (size == 0) return;
+
     // Build Huffman tree
-    auto root = buildHuffmanTree(data);
+    auto root = buildHuffmanTree(data, size);
 
-    // Generate encoding table
-    CodeMap codes;
-    generateHuffmanCodes(root, "", codes);
+    // Generate canonical codes
+    CodeLengths lengths;
+    std::size_t max_length = buildCodeLengths(root, lengths);
 
-    // Serialize tree structure
-    auto tree_data = serializeTree(root);
+    CodeTable codes;
+    assignCanonicalCodes(lengths, codes);
 
-    // Compress data
-    std::vector<HuffmanByte> compressed;
-    std::string bits;
+    // Add original data size
+    assert(size <= kMaxDataSize);
+    std::uint32_t data_size = static_cast<std::uint32_t>(size);
+    for (std::size_t i = 0; i < sizeof(std::uint32_t); ++i) {
+        output.write(static_cast<char>((data_size >> (i * 8)) & 0xFF));
+    }
+
+    // Add code lengths
+    writeCodeLengths(lengths, output);
 
-    // Add tree size
-    std::size_t tree_size = tree_data.size();
-    for (std::size_t i = 0; i < sizeof(std::size_t); ++i) {
-        compressed.push_back(static_cast<HuffmanByte>((tree_size >> (i * 8)) & 0xFF));
+    // A lone symbol doesn't need the data body
+    if (!root->left && !root->right) {
+        return;
     }
 
-    // Add original data size
-    std::size_t data_size = data.size();
-    for (std::size_t i = 0; i < sizeof(std::size_t); ++i) {
-        compressed.push_back(static_cast<HuffmanByte>((data_size >> (i * 8)) & 0xFF));
+    // Reserve the space of the worst case
+    output.grow((size * max_length + 7) / 8 + kNumStreams * sizeof(BitWriter::bitbuf_type) +
+                (kNumStreams - 1) * sizeof(std::uint32_t));
+
+    if (size < kMinFourStreamSize) {
+        encodeStream(data, size, codes, max_length, output);
+        return;
     }
 
-    // Add tree data
-    compressed.insert(compressed.end(), tree_data.begin(), tree_data.end());
+    // Reserve the jump table
+    std::size_t jump_table = output.size();
+    output.forward((kNumStreams - 1) * sizeof(std::uint32_t));
+
+    std::size_t segment_size = (size + kNumStreams - 1) / kNumStreams;
+    for (std::size_t n = 0; n < kNumStreams; n++) {
+        std::size_t first = segment_size * n;
+        std::size_t count = (n < kNumStreams - 1) ? segment_size : (size - first);
+        std::size_t stream_start = output.size();
+        encodeStream(data + first, count, codes, max_length, output);
+
+        if (n < kNumStreams - 1) {
+            std::size_t stream_size = output.size() - stream_start;
+            writeUInt32(output, jump_table + n * sizeof(std::uint32_t),
+                        static_cast<std::uint32_t>(stream_size));
+        }
+    }
+}
 
-    // Compress data body
-    for (HuffmanByte c : data) {
-        bits += codes[c];
-        while (bits.length() >= 8) {
-            std::bitset<8> byte(bits.substr(0, 8));
-            compressed.push_back(static_cast<HuffmanByte>(byte.to_ulong()));
-            bits = bits.substr(8);
+void HuffmanCompressor::encodeStream(const HuffmanByte * data, std::size_t size, const CodeTable & codes,
+                                     std::size_t max_length, MemoryBuffer & output)
+{
+    // Put as many codes as possible between two flushes
+    BitWriter writer(output);
+    const HuffmanCode * code_table = codes.data();
+
+    std::size_t i = 0;
+    if (max_length <= BitWriter::kMaxPutBits / 4) {
+        std::size_t limit = size & ~static_cast<std::size_t>(3);
+        for (; i < limit; i += 4) {
+            const HuffmanCode & code0 = code_table[data[i + 0]];
+            const HuffmanCode & code1 = code_table[data[i + 1]];
+            const HuffmanCode & code2 = code_table[data[i + 2]];
+            const HuffmanCode & code3 = code_table[data[i + 3]];
+            writer.put(code0.code, code0.length);
+            writer.put(code1.code, code1.length);
+            writer.put(code2.code, code2.length);
+            writer.put(code3.code, code3.length);
+            writer.flush();
+        }
+    } else if (max_length <= BitWriter::kMaxPutBits / 3) {
+        std::size_t limit = (size / 3) * 3;
+        for (; i < limit; i += 3) {
+            const HuffmanCode & code0 = code_table[data[i + 0]];
+            const HuffmanCode & code1 = code_table[data[i + 1]];
+            const HuffmanCode & code2 = code_table[data[i + 2]];
+            writer.put(code0.code, code0.length);
+            writer.put(code1.code, code1.length);
+            writer.put(code2.code, code2.length);
+            writer.flush();
+        }
+    } else if (max_length <= BitWriter::kMaxPutBits / 2) {
+        std::size_t limit = size & ~static_cast<std::size_t>(1);
+        for (; i < limit; i += 2) {
+            const HuffmanCode & code0 = code_table[data[i + 0]];
+            const HuffmanCode & code1 = code_table[data[i + 1]];
+            writer.put(code0.code, code0.length);
+            writer.put(code1.code, code1.length);
+            writer.flush();
         }
     }
 
+    for (; i < size; i++) {
+        const HuffmanCode & code = code_table[data[i]];
+        writer.put(code.code, code.length);
+        writer.flush();
+    }
+
     // Handle remaining bits
-    if (!bits.empty()) {
-        while (bits.length() < 8) {
-            bits += '0';
+    writer.finish();
+}
+
+//
+// Each refill() ensures there are at least BitReader::kMinRefillBits bits,
+// so (kMinRefillBits / max_length) symbols can be decoded per refill.
+// If SingleLevel is true, all the codes are resolved by one table lookup.
+//
+template <bool SingleLevel>
+static ZIPLAB_FORCED_INLINE
+HuffmanByte decodeSymbol(BitReader & reader, const std::uint32_t * table, std::size_t table_bits)
+{
+    std::size_t level_bits = table_bits;
+    std::uint32_t entry = table[reader.peek(level_bits)];
+    if (!SingleLevel) {
+        while (ziplab_unlikely((entry & HuffmanCompressor::kDecodeLinkFlag) != 0)) {
+            // Long code, continue with the sub table
+            reader.consume(level_bits);
+            level_bits = entry & HuffmanCompressor::kDecodeBitsMask;
+            std::size_t sub_base = (entry & HuffmanCompressor::kDecodeValueMask) >> 8;
+            entry = table[sub_base + reader.peek(level_bits)];
+        }
+    }
+    assert((entry & HuffmanCompressor::kDecodeLinkFlag) == 0);
+    reader.consume(entry & HuffmanCompressor::kDecodeBitsMask);
+    return static_cast<HuffmanByte>(entry >> 8);
+}
+
+template <bool SingleLevel>
+static void decodeStream(BitReader & reader, HuffmanByte * output, std::size_t count,
+                         const std::uint32_t * table, std::size_t table_bits, std::size_t max_length)
+{
+    std::size_t i = 0;
+    if (max_length * 4 <= BitReader::kMinRefillBits) {
+        // One refill is enough for 4 symbols
+        std::size_t limit = count & ~static_cast<std::size_t>(3);
+        for (; i < limit; i += 4) {
+            reader.refill();
+            output[i + 0] = decodeSymbol<SingleLevel>(reader, table, table_bits);
+            output[i + 1] = decodeSymbol<SingleLevel>(reader, table, table_bits);
+            output[i + 2] = decodeSymbol<SingleLevel>(reader, table, table_bits);
+            output[i + 3] = decodeSymbol<SingleLevel>(reader, table, table_bits);
+        }
+    } else if (max_length * 3 <= BitReader::kMinRefillBits) {
+        // One refill is enough for 3 symbols
+        std::size_t limit = (count / 3) * 3;
+        for (; i < limit; i += 3) {
+            reader.refill();
+            output[i + 0] = decodeSymbol<SingleLevel>(reader, table, table_bits);
+            output[i + 1] = decodeSymbol<SingleLevel>(reader, table, table_bits);
+            output[i + 2] = decodeSymbol<SingleLevel>(reader, table, table_bits);
         }
-        std::bitset<8> byte(bits);
-        compressed.push_back(static_cast<HuffmanByte>(byte.to_ulong()));
     }
 
-    return compressed;
+    for (; i < count; i++) {
+        reader.refill();
+        output[i] = decodeSymbol<SingleLevel>(reader, table, table_bits);
+    }
+}
+
+template <bool SingleLevel>
+static void decodeFourStreams(BitReader (&readers)[HuffmanCompressor::kNumStreams],
+                              HuffmanByte * output, std::size_t segment_size, std::size_t last_size,
+                              const std::uint32_t * table, std::size_t table_bits, std::size_t max_length)
+{
+    BitReader & reader0 = readers[0];
+    BitReader & reader1 = readers[1];
+    BitReader & reader2 = readers[2];
+    BitReader & reader3 = readers[3];
+
+    HuffmanByte * output0 = output;
+    HuffmanByte * output1 = output0 + segment_size;
+    HuffmanByte * output2 = output1 + segment_size;
+    HuffmanByte * output3 = output2 + segment_size;
+
+    // The four streams are independent, so the table lookups can be overlapped.
+    std::size_t i = 0;
+    if (max_length * 4 <= BitReader::kMinRefillBits) {
+        std::size_t limit = last_size & ~static_cast<std::size_t>(3);
+        for (; i < limit; i += 4) {
+            reader0.refill();
+            reader1.refill();
+            reader2.refill();
+            reader3.refill();
+            for (std::size_t j = 0; j < 4; j++) {
+                output0[i + j] = decodeSymbol<SingleLevel>(reader0, table, table_bits);
+                output1[i + j] = decodeSymbol<SingleLevel>(reader1, table, table_bits);
+                output2[i + j] = decodeSymbol<SingleLevel>(reader2, table, table_bits);
+                output3[i + j] = decodeSymbol<SingleLevel>(reader3, table, table_bits);
+            }
+        }
+    }
+    else if (max_length * 3 <= BitReader::kMinRefillBits) {
+        std::size_t limit = (last_size / 3) * 3;
+        for (; i < limit; i += 3) {
+            reader0.refill();
+            reader1.refill();
+            reader2.refill();
+            reader3.refill();
+            for (std::size_t j = 0; j < 3; j++) {
+                output0[i + j] = decodeSymbol<SingleLevel>(reader0, table, table_bits);
+                output1[i + j] = decodeSymbol<SingleLevel>(reader1, table, table_bits);
+                output2[i + j] = decodeSymbol<SingleLevel>(reader2, table, table_bits);
+                output3[i + j] = decodeSymbol<SingleLevel>(reader3, table, table_bits);
+            }
+        }
+    }
+
+    for (; i < last_size; i++) {
+        reader0.refill();
+        reader1.refill();
+        reader2.refill();
+        reader3.refill();
+        output0[i] = decodeSymbol<SingleLevel>(reader0, table, table_bits);
+        output1[i] = decodeSymbol<SingleLevel>(reader1, table, table_bits);
+        output2[i] = decodeSymbol<SingleLevel>(reader2, table, table_bits);
+        output3[i] = decodeSymbol<SingleLevel>(reader3, table, table_bits);
+    }
+
+    // The last segment may be shorter than the others
+    for (; i < segment_size; i++) {
+        reader0.refill();
+        reader1.refill();
+        reader2.refill();
+        output0[i] = decodeSymbol<SingleLevel>(reader0, table, table_bits);
+        output1[i] = decodeSymbol<SingleLevel>(reader1, table, table_bits);
+        output2[i] = decodeSymbol<SingleLevel>(reader2, table, table_bits);
+    }
 }
 
 std::vector<HuffmanByte>
 HuffmanCompressor::decompress(const std::vector<HuffmanByte> & compressed_data)
 {
-    if (compressed_data.size() < 2 * sizeof(std::size_t)) return {};
+    MemoryBuffer output;
+    if (!decompress(compressed_data.data(), compressed_data.size(), output)) {
+        return {};
+    }
 
-    std::size_t pos = 0;
+    const HuffmanByte * decompressed = reinterpret_cast<const HuffmanByte *>(output.data());
+    return std::vector<HuffmanByte>(decompressed, decompressed + output.size());
+}
 
-    // Read tree size
-    std::size_t tree_size = 0;
-    for (std::size_t i = 0; i < sizeof(std::size_t); ++i) {
-        tree_size |= static_cast<std::size_t>(compressed_data[pos++]) << (i * 8);
-    }
+bool HuffmanCompressor::decompress(const HuffmanByte * data, std::size_t size, MemoryBuffer & output)
+{
+    if (size < sizeof(std::uint32_t)) return false;
+
+    std::size_t pos = 0;
 
     // Read original data size
-    std::size_t data_size = 0;
-    for (std::size_t i = 0; i < sizeof(std::size_t); ++i) {
-        data_size |= static_cast<std::size_t>(compressed_data[pos++]) << (i * 8);
+    std::size_t data_size = readUInt32(data + pos);
+    pos += sizeof(std::uint32_t);
+
+    // Read code lengths
+    CodeLengths lengths;
+    std::size_t max_length = readCodeLengths(data, size, pos, lengths);
+    if (max_length == 0) return false;
+
+    std::size_t num_symbols = 0;
+    std::size_t last_symbol = 0;
+    std::size_t min_length = max_length;
+    for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+        if (lengths[symbol] != 0) {
+            num_symbols++;
+            last_symbol = symbol;
+            if (lengths[symbol] < min_length)
+                min_length = lengths[symbol];
+        }
     }
 
-    // Read and rebuild tree
-    std::vector<HuffmanByte> tree_data(compressed_data.begin() + pos,
-                                       compressed_data.begin() + pos + tree_size);
-    size_t tree_index = 0;
-    auto root = deserializeTree(tree_data, tree_index);
-    pos += tree_size;
+    // Each symbol takes min_length bits of the data body at least, reject the data
+    // size that the body can't hold before allocating. A lone symbol has no body,
+    // its size is bounded by the 32-bit field only.
+    if ((num_symbols > 1) && (data_size > (size - pos) * 8 / min_length)) return false;
 
     // Decompress data
-    std::vector<HuffmanByte> decompressed;
-    auto current = root;
-    std::string bits;
+    output.grow(data_size);
+    HuffmanByte * decompressed = reinterpret_cast<HuffmanByte *>(output.current());
+
+    if (num_symbols == 1) {
+        // A lone symbol, there is no data body
+        std::fill(decompressed, decompressed + data_size, static_cast<HuffmanByte>(last_symbol));
+        output.forward(data_size);
+        return true;
+    }
 
-    while (decompressed.size() < data_size && pos < compressed_data.size()) {
-        std::bitset<8> byte(compressed_data[pos++]);
-        bits += byte.to_string();
+    CodeTable codes;
+    assignCanonicalCodes(lengths, codes);
 
-        while (!bits.empty() && decompressed.size() < data_size) {
-            if (!current) current = root;
+    std::size_t table_bits = buildDecodeTable(lengths, codes, max_length, decode_table_);
+    const std::uint32_t * decode_table = decode_table_.data();
+    bool single_level = (max_length <= table_bits);
 
-            if (bits[0] == '0') {
-                current = current->left;
-            } else {
-                current = current->right;
-            }
-
-            if (current && !current->left && !current->right) {
-                decompressed.push_back(current->data);
-                current = root;
-            }
-
-            bits = bits.substr(1);
+    if (data_size < kMinFourStreamSize) {
+        BitReader reader(data + pos, size - pos);
+        if (single_level)
+            decodeStream<true>(reader, decompressed, data_size, decode_table, table_bits, max_length);
+        else
+            decodeStream<false>(reader, decompressed, data_size, decode_table, table_bits, max_length);
+        if (reader.is_overflow()) return false;
+    } else {
+        // Read the jump table
+        std::size_t jump_table_size = (kNumStreams - 1) * sizeof(std::uint32_t);
+        if ((pos + jump_table_size) > size) return false;
+
+        std::size_t stream_sizes[kNumStreams];
+        std::size_t total_size = 0;
+        for (std::size_t n = 0; n < kNumStreams - 1; n++) {
+            stream_sizes[n] = readUInt32(data + pos + n * sizeof(std::uint32_t));
+            total_size += stream_sizes[n];
+        }
+        pos += jump_table_size;
+        if ((pos + total_size) > size) return false;
+        stream_sizes[kNumStreams - 1] = size - pos - total_size;
+
+        const HuffmanByte * stream = data + pos;
+        BitReader readers[kNumStreams] = {
+            { stream, stream_sizes[0] },
+            { stream + stream_sizes[0], stream_sizes[1] },
+            { stream + stream_sizes[0] + stream_sizes[1], stream_sizes[2] },
+            { stream + total_size, stream_sizes[3] }
+        };
+
+        std::size_t segment_size = (data_size + kNumStreams - 1) / kNumStreams;
+        std::size_t last_size = data_size - segment_size * (kNumStreams - 1);
+        if (single_level)
+            decodeFourStreams<true>(readers, decompressed, segment_size, last_size,
+                                    decode_table, table_bits, max_length);
+        else
+            decodeFourStreams<false>(readers, decompressed, segment_size, last_size,
+                                     decode_table, table_bits, max_length);
+
+        for (std::size_t n = 0; n < kNumStreams; n++) {
+            if (readers[n].is_overflow()) return false;
         }
     }
 
-    return decompressed;
+    output.forward(data_size);
+    return true;
 }
 
-void HuffmanCompressor::compressFile(const std::string & inputFile, const std::string & outputFile)
+bool HuffmanCompressor::compressFile(const std::string & inputFile, const std::string & outputFile)
 {
-    std::ifstream inFile(inputFile, std::ios::binary);
-    std::ofstream outFile(outputFile, std::ios::binary);
+    FileReader reader;
+    FileWriter writer(outputFile);
+    if (!reader.open(inputFile) || !writer.is_opened()) return false;
 
-    // Calculate char frequencies
-    FreqMap freqMap;
-    char ch;
-    while (inFile.get(ch)) {
-        freqMap[(HuffmanByte)ch]++;
-    }
+    bool success = true;
+    std::unique_ptr<HuffmanByte[]> block(new HuffmanByte[kFileBlockSize]);
+    MemoryBuffer compressed(kFileBlockSize * 2);
 
-    // Build Huffman tree
-    HuffmanNode * root = buildHuffmanTree(freqMap);
+    while (true) {
+        std::size_t block_size = reader.read(reinterpret_cast<char *>(block.get()), kFileBlockSize);
+        if (block_size == 0) break;
 
-    // Generate encoding table
-    CodeMap huffmanCodes;
-    generateHuffmanCodes(root, "", huffmanCodes);
+        // Reserve the compressed block size
+        compressed.seek_to_begin();
+        compressed.grow(sizeof(std::uint32_t));
+        compressed.forward(sizeof(std::uint32_t));
 
-    // Serialize tree structure
-    outFile << freqMap.size() << std::endl;
-    for (auto& pair : huffmanCodes) {
-        outFile << pair.first << " " << pair.second << std::endl;
-    }
+        compress(block.get(), block_size, compressed);
 
-    // Reset the input file pointer
-    inFile.clear();
-    inFile.seekg(0);
+        std::size_t compressed_size = compressed.size() - sizeof(std::uint32_t);
+        writeUInt32(compressed, 0, static_cast<std::uint32_t>(compressed_size));
 
-    // Compresse the data
-    std::stringstream compressedData;
-    while (inFile.get(ch)) {
-        compressedData << huffmanCodes[ch];
+        if (writer.write(compressed.data(), compressed.size()) != compressed.size()) {
+            success = false;
+            break;
+        }
     }
 
-    // Write the compressed data to output file
-    std::string compressedStr = compressedData.str();
-    outFile << compressedStr;
-
     // Cleanup
-    inFile.close();
-    outFile.close();
-    if (root) {
-        delete root;
-    }
+    reader.close();
+    writer.close();
+    return success;
 }
 
-void HuffmanCompressor::decompressFile(const std::string & inputFile, const std::string & outputFile)
+bool HuffmanCompressor::decompressFile(const std::string & inputFile, const std::string & outputFile)
 {
-    std::ifstream inFile(inputFile, std::ios::binary);
-    std::ofstream outFile(outputFile, std::ios::binary);
+    FileReader reader;
+    FileWriter writer(outputFile);
+    if (!reader.open(inputFile) || !writer.is_opened()) return false;
 
-    // Read the encode table
-    std::size_t size;
-    inFile >> size;
+    bool success = true;
+    std::vector<HuffmanByte> compressed;
+    MemoryBuffer decompressed(kFileBlockSize);
+
+    while (true) {
+        // Read the compressed block size
+        HuffmanByte size_bytes[sizeof(std::uint32_t)];
+        std::size_t read_bytes = reader.read(reinterpret_cast<char *>(size_bytes), sizeof(size_bytes));
+        if (read_bytes == 0) break;
+        if (read_bytes != sizeof(size_bytes)) {
+            success = false;
+            break;
+        }
 
-    // ignore the NewLinw chars
-    inFile.ignore();
+        // A block of the encoder is never larger than kMaxCompressedBlockSize
+        std::size_t compressed_size = readUInt32(size_bytes);
+        if (compressed_size > kMaxCompressedBlockSize) {
+            success = false;
+            break;
+        }
 
-    std::unordered_map<std::string, char> codeMap;
-    char ch;
-    std::string code;
-    for (std::size_t i = 0; i < size; ++i) {
-        inFile.get(ch);
-        std::getline(inFile, code);
-        codeMap[code] = ch;
-    }
+        compressed.resize(compressed_size);
+        read_bytes = reader.read(reinterpret_cast<char *>(compressed.data()), compressed_size);
+        if (read_bytes != compressed_size) {
+            success = false;
+            break;
+        }
 
-    // Decompress the data
-    std::stringstream compressedData;
-    char bit;
-    while (inFile.get(bit)) {
-        compressedData << bit;
-    }
-    std::string compressedStr = compressedData.str();
+        // The data size of the block, a block holds kFileBlockSize bytes at most
+        if ((compressed_size < sizeof(std::uint32_t)) || (readUInt32(compressed.data()) > kFileBlockSize)) {
+            success = false;
+            break;
+        }
 
-    // Decode data
-    std::string decodedStr;
-    std::string currentCode;
-    for (char bit : compressedStr) {
-        currentCode += bit;
-        if (codeMap.find(currentCode) != codeMap.end()) {
-            decodedStr += codeMap[currentCode];
-            currentCode.clear();
+        decompressed.seek_to_begin();
+        if (!decompress(compressed.data(), compressed_size, decompressed)) {
+            success = false;
+            break;
         }
-    }
 
-    // Write the decode data to output file
-    outFile << decodedStr;
+        if (writer.write(decompressed.data(), decompressed.size()) != decompressed.size()) {
+            success = false;
+            break;
+        }
+    }
 
     // Cleanup
-    inFile.close();
-    outFile.close();
+    reader.close();
+    writer.close();
+    return success;
 }
 
 } // namespace ziplab
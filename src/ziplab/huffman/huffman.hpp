@@ -5,12 +5,15 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <array>
 #include <vector>
 #include <string>
-#include <queue>
-#include <unordered_map>
 #include <memory>
 
+#include <assert.h>
+
+#include "ziplab/stream/MemoryBuffer.h"
+
 namespace ziplab {
 
 using HuffmanByte = unsigned char;
@@ -23,48 +26,184 @@ public:
     HuffmanNode * left;
     HuffmanNode * right;
 
+    HuffmanNode() : data(0), freq(0), left(nullptr), right(nullptr) {}
     HuffmanNode(HuffmanByte data, std::uint32_t freq) : data(data), freq(freq), left(nullptr), right(nullptr) {}
 };
 
-struct HuffmanCompare
-{
-    inline bool operator () (HuffmanNode * a, HuffmanNode * b) {
-        return (a->freq > b->freq);
-    }
-};
-
 class HuffmanCompressor {
 public:
-    using FreqMap = std::unordered_map<HuffmanByte, std::uint32_t>;
-    using CodeMap = std::unordered_map<HuffmanByte, std::string>;
+    static constexpr std::size_t kMaxSymbols = 256;
+
+    using Histogram = std::array<std::uint32_t, kMaxSymbols>;
+
+    // A Huffman tree has at most 256 leaves and 255 internal nodes.
+    static constexpr std::size_t kMaxNodes = kMaxSymbols * 2 - 1;
+
+    // The longest code that can be stored in a HuffmanCode.
+    static constexpr std::size_t kMaxCodeLength = 32;
+
+    // The shortest length limit that can hold all 256 symbols.
+    static constexpr std::size_t kMinCodeLength = 8;
+
+    // The default length limit, all the codes can be resolved by the first level
+    // decode table (kDecodeTableBits), which is the fast path of the decoder.
+    static constexpr std::size_t kDefaultCodeLength = 12;
+
+    // Canonical Huffman code, the code bits are stored in the low [length] bits.
+    struct HuffmanCode {
+        std::uint32_t code;
+        std::uint32_t length;
+    };
+
+    using CodeLengths = std::array<std::uint8_t, kMaxSymbols>;
+    using CodeTable   = std::array<HuffmanCode, kMaxSymbols>;
+
+    //
+    // The decode table entry:
+    //
+    // leaf entry: [symbol: 8 bits][code bits in this level: 8 bits]
+    // link entry: [kDecodeLinkFlag][offset of sub table: 23 bits][sub table bits: 8 bits]
+    //
+    using DecodeTable = std::vector<std::uint32_t>;
+
+    // The number of bits resolved by the first level decode table.
+    static constexpr std::size_t kDecodeTableBits = 12;
+
+    static constexpr std::uint32_t kDecodeLinkFlag  = 0x80000000u;
+    static constexpr std::uint32_t kDecodeBitsMask  = 0x000000FFu;
+    static constexpr std::uint32_t kDecodeValueMask = 0x7FFFFF00u;
+
+    //
+    // The format of compress():
+    //
+    // [data size: 4 bytes][code lengths][data body]
+    //
+    // The data size is a little-endian 32-bit field, so the data must be smaller
+    // than 4 GB. A lone symbol has no data body.
+    //
+    static constexpr std::size_t kMaxDataSize = 0xFFFFFFFFu;
+
+    //
+    // The data body of the blocks not smaller than kMinFourStreamSize is split into
+    // kNumStreams segments, each segment is encoded into an independent bitstream,
+    // so the decoder can decode the four streams in one loop.
+    //
+    // [stream 0 size: 4 bytes][stream 1 size: 4 bytes][stream 2 size: 4 bytes]
+    // [stream 0][stream 1][stream 2][stream 3]
+    //
+    // Each segment has (data_size + 3) / 4 symbols, except the last one.
+    //
+    static constexpr std::size_t kNumStreams = 4;
+    static constexpr std::size_t kMinFourStreamSize = 256;
+
+    //
+    // The file format of compressFile(): a sequence of independent blocks,
+    // each block has its own code lengths header.
+    //
+    // [compressed block size: 4 bytes][compressed block: compress() output]
+    //
+    static constexpr std::size_t kFileBlockSize = 128 * 1024;
+
+    // The largest compressed block: each symbol takes kMaxCodeLength bits,
+    // plus the headers and the padding of the streams.
+    static constexpr std::size_t kMaxCompressedBlockSize = kFileBlockSize * kMaxCodeLength / 8 + 1024;
+
+    HuffmanCompressor(std::size_t max_code_length = kDefaultCodeLength) : node_count_(0) {
+        setMaxCodeLength(max_code_length);
+    }
+
+    std::size_t maxCodeLength() const { return max_code_length_; }
+
+    // Set the length limit of codes, it's clamped to [kMinCodeLength, kMaxCodeLength].
+    void setMaxCodeLength(std::size_t max_code_length) {
+        if (max_code_length < kMinCodeLength)
+            max_code_length = kMinCodeLength;
+        else if (max_code_length > kMaxCodeLength)
+            max_code_length = kMaxCodeLength;
+        max_code_length_ = max_code_length;
+    }
 
     // Compress data
     std::vector<HuffmanByte> compress(const std::vector<HuffmanByte> & data);
 
+    // Compress data and append it to the output buffer
+    void compress(const HuffmanByte * data, std::size_t size, MemoryBuffer & output);
+
     // Decompress data
     std::vector<HuffmanByte> decompress(const std::vector<HuffmanByte> & compressed_data);
 
-    // Compress file
-    void compressFile(const std::string & inputFile, const std::string & outputFile);
+    // Decompress data and append it to the output buffer, return false if the data is invalid
+    bool decompress(const HuffmanByte * data, std::size_t size, MemoryBuffer & output);
+
+    // Compress file, kFileBlockSize bytes at a time, return false if the files can't be read or written
+    bool compressFile(const std::string & inputFile, const std::string & outputFile);
 
-    // Decompress file
-    void decompressFile(const std::string & inputFile, const std::string & outputFile);
+    // Decompress file, return false if the files can't be read or written, or the data is invalid
+    bool decompressFile(const std::string & inputFile, const std::string & outputFile);
 
 private:
-    // Build Huffman tree
-    HuffmanNode * buildHuffmanTree(const FreqMap & freqMap);
+    std::size_t max_code_length_;
+
+    //
+    // The nodes of the current Huffman tree, they are reused by the next tree.
+    // The leaves sorted by frequency are in [0, num_leaves), and the internal nodes
+    // are in [num_leaves, node_count_), the root is the last node.
+    //
+    std::array<HuffmanNode, kMaxNodes> node_pool_;
+    std::size_t node_count_;
+    DecodeTable decode_table_;
+
+    HuffmanNode * newNode(HuffmanByte data, std::uint32_t freq) {
+        assert(node_count_ < kMaxNodes);
+        HuffmanNode * node = &node_pool_[node_count_++];
+        node->data  = data;
+        node->freq  = freq;
+        node->left  = nullptr;
+        node->right = nullptr;
+        return node;
+    }
+
+    // Count the frequencies of symbols
+    void buildHistogram(const HuffmanByte * data, std::size_t size, Histogram & histogram);
+
+    // Build Huffman tree with the two-queue method
+    HuffmanNode * buildHuffmanTree(const Histogram & histogram);
 
     // Build Huffman tree
-    HuffmanNode * buildHuffmanTree(const std::vector<HuffmanByte> & data);
+    HuffmanNode * buildHuffmanTree(const HuffmanByte * data, std::size_t size);
+
+    // Generate code lengths from the depth of leaves, return the max code length
+    std::size_t generateCodeLengths(HuffmanNode * node, std::size_t depth, CodeLengths & lengths);
+
+    // Build code lengths, no longer than max_code_length_, return the max code length
+    std::size_t buildCodeLengths(HuffmanNode * root, CodeLengths & lengths);
+
+    // Build the optimal length-limited code lengths (package-merge)
+    void buildLimitedCodeLengths(const HuffmanNode * leaves, std::size_t num_leaves,
+                                 std::size_t max_length, CodeLengths & lengths);
+
+    // Assign the canonical codes by code lengths
+    void assignCanonicalCodes(const CodeLengths & lengths, CodeTable & codes);
+
+    // Write the code lengths header
+    void writeCodeLengths(const CodeLengths & lengths, MemoryBuffer & output);
+
+    // Read the code lengths header, return the max code length, or 0 if it's invalid
+    std::size_t readCodeLengths(const HuffmanByte * input, std::size_t size, std::size_t & pos,
+                                CodeLengths & lengths);
 
-    // Generate encoding table
-    void generateHuffmanCodes(HuffmanNode * node, const std::string & code, CodeMap & codes);
+    // Encode the data into one bitstream
+    void encodeStream(const HuffmanByte * data, std::size_t size, const CodeTable & codes,
+                      std::size_t max_length, MemoryBuffer & output);
 
-    // Serialize Huffman tree
-    std::vector<HuffmanByte> serializeTree(HuffmanNode * root);
+    // Build multi-level decode table, return the bits of first level table
+    std::size_t buildDecodeTable(const CodeLengths & lengths, const CodeTable & codes,
+                                 std::size_t max_length, DecodeTable & table);
 
-    // Deserialize Huffman tree
-    HuffmanNode * deserializeTree(const std::vector<HuffmanByte> & tree_data, std::size_t & index);
+    // Fill the decode table entries of codes that start with the prefix
+    void fillDecodeTable(const CodeLengths & lengths, const CodeTable & codes,
+                         std::uint64_t prefix, std::size_t prefix_len,
+                         std::size_t table_base, std::size_t table_bits, DecodeTable & table);
 };
 
 } // namespace ziplab
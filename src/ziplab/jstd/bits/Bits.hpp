@@ -10,6 +10,7 @@
 #include <stdbool.h>
 #include <type_traits>
 #include <limits.h>
+#include <limits>       // For std::numeric_limits<T>
 #include <assert.h>
 
 #include "ziplab/basic/stddef.h"
@@ -701,24 +702,24 @@ uint32_t bsr64(uint64_t n)
     assert(n != 0);
     ZIPLAB_ASSUME(n != 0);
 #if (jstd_cplusplus >= 2020L)
-    return (uint32_t)(31 - std::countl_zero(n));
+    return (uint32_t)(63 - std::countl_zero(n));
 #elif (defined(_MSC_VER) && (_MSC_VER >= 1500)) && !defined(__clang__)
     unsigned long index;
     ::_BitScanReverse64(&index, (unsigned long long)n);
     return (uint32_t)index;
 #elif defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
   #if __has_builtin(__builtin_clzll)
-    return (uint32_t)(31 - __builtin_clzll((unsigned long long)n));
+    return (uint32_t)(63 - __builtin_clzll((unsigned long long)n));
   #elif defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
-    return (uint32_t)(31 - __builtin_clzll((unsigned long long)n));
+    return (uint32_t)(63 - __builtin_clzll((unsigned long long)n));
   #elif defined(__GNUC__) || __has_builtin(__bsrq) || (__clang_major__ >= 12)
     // gcc: __bsrq(n)
     return (uint32_t)__bsrq(n);
   #else
-    return (uint32_t)(31 - __internal_clzll(n));
+    return (uint32_t)(63 - __internal_clzll(n));
   #endif
 #else
-    return (uint32_t)(31 - __internal_clzll(n));
+    return (uint32_t)(63 - __internal_clzll(n));
 #endif
 }
 
@@ -267,7 +267,7 @@ public:
 
     size_type count_byte(ssize_type pos) const noexcept {
         // Count number of bits at the specified pos
-        assert(index < kTotalBytes);
+        assert(static_cast<size_type>(pos) < kTotalBytes);
         const unsigned char * first = (const unsigned char *)(const void *)array_;
         const unsigned char * const ptr = first + pos;
         return static_cast<size_type>(Bits::lookup_popcnt8(*ptr));
@@ -413,7 +413,7 @@ private:
     }
 
     inline std::uint8_t _get_byte(size_type pos) const {
-        assert(index < kTotalBytes);
+        assert(pos < kTotalBytes);
         const unsigned char * first = (const unsigned char *)(const void *)array_;
         const unsigned char * const ptr = first + pos;
         return static_cast<std::uint8_t>(*ptr);
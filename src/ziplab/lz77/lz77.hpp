@@ -8,11 +8,66 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <cstring>      // For std::memcpy()
+
+#include <assert.h>
+
+#include "ziplab/basic/stddef.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>     // For _BitScanForward64()
+#endif
 
 namespace ziplab {
 
 using LZByte = unsigned char;
 
+static inline
+std::uint32_t lz_count_trailing_zeros64(std::uint64_t value)
+{
+    assert(value != 0);
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<std::uint32_t>(index);
+#elif defined(__GNUC__) || defined(__clang__)
+    return static_cast<std::uint32_t>(__builtin_ctzll(value));
+#else
+    std::uint32_t count = 0;
+    while ((value & 1) == 0) {
+        value >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+// The length of the common prefix of first and second, max_len at most.
+static inline
+std::size_t lz_match_length(const LZByte * first, const LZByte * second, std::size_t max_len)
+{
+    std::size_t len = 0;
+    while ((len + sizeof(std::uint64_t)) <= max_len) {
+        std::uint64_t value1, value2;
+        std::memcpy(&value1, first + len, sizeof(value1));
+        std::memcpy(&value2, second + len, sizeof(value2));
+        std::uint64_t diff = value1 ^ value2;
+        if (diff != 0) {
+#if (ZIPLAB_ENDIAN == ZIPLAB_LITTLE_ENDIAN)
+            // The index of the first different byte
+            return (len + static_cast<std::size_t>(lz_count_trailing_zeros64(diff) >> 3));
+#else
+            break;
+#endif
+        }
+        len += sizeof(std::uint64_t);
+    }
+    while (len < max_len && first[len] == second[len]) {
+        len++;
+    }
+    return len;
+}
+
 } // namespace ziplab
 
 #endif // ZIPLAB_LZ77_HPP
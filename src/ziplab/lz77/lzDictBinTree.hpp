@@ -0,0 +1,269 @@
+#ifndef ZIPLAB_LZ77_LZDICTBINTREE_HPP
+#define ZIPLAB_LZ77_LZDICTBINTREE_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <cstring>      // For std::memset()
+
+#include <assert.h>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/lz77/lz77.hpp"
+
+namespace ziplab {
+
+//
+// A binary-tree match finder (BT4) of a sliding window, the alternative of
+// LZDictHashmap for the high compression levels.
+//
+// The positions with the same 4-byte hash form a binary search tree, ordered
+// by the strings that start at them. Inserting a position walks down from the
+// root (the latest position of the hash) to the place of the new string, and
+// it visits the closest strings on the way, so it finds the longest matches
+// in O(log window). The tree is re-rooted at the new position, the nodes which
+// have left the window are cut off when they are reached.
+//
+// The 3-byte matches are found by a hash table of the latest position with
+// the same 3-byte hash, they aren't in the tree of a 4-byte hash.
+//
+// The tree keeps (kWindowSize + 1) nodes, so a match may be kWindowSize
+// back like the matches of LZDictHashmap, and the hash tables are sized to
+// the data by reset(), a small input doesn't clear the whole tables.
+//
+// find_matches() reports each match which is longer than all the previous
+// ones, from the nearest to the farthest, the list of (length, distance)
+// pairs feeds the parsers which weigh the shorter but nearer matches.
+//
+template <std::size_t WindowBits, std::size_t HashBits = 16>
+class LZDictBinTree {
+public:
+    using size_type = std::size_t;
+    using pos_type = std::uint32_t;
+
+    static constexpr size_type kWindowBits = WindowBits;
+    static constexpr size_type kWindowSize = static_cast<size_type>(1) << WindowBits;
+    static constexpr size_type kWindowMask = kWindowSize - 1;
+
+    // The distances are [1, kMaxDistance], one more node than the window keeps
+    // (pos - kWindowSize) until pos is inserted
+    static constexpr size_type kMaxDistance = kWindowSize;
+    static constexpr size_type kCyclicSize = kWindowSize + 1;
+
+    static constexpr size_type kHash4Bits = HashBits;
+    static constexpr size_type kHash4Size = static_cast<size_type>(1) << kHash4Bits;
+    static constexpr size_type kHash3Bits = (HashBits > 12) ? 12 : HashBits;
+    static constexpr size_type kHash3Size = static_cast<size_type>(1) << kHash3Bits;
+    static constexpr size_type kMinHashBits = (HashBits > 10) ? 10 : HashBits;
+
+    // A position needs kKeyLen bytes to be inserted
+    static constexpr size_type kKeyLen = 4;
+    static constexpr size_type kMinMatchLength = 3;
+
+    static constexpr pos_type kEmpty = static_cast<pos_type>(-1);
+
+    static_assert((WindowBits >= 4 && WindowBits <= 24),
+                  "LZDictBinTree<W, H>'s WindowBits must be in [4, 24].");
+    static_assert((HashBits >= 8 && HashBits <= 24),
+                  "LZDictBinTree<W, H>'s HashBits must be in [8, 24].");
+
+    struct Match {
+        std::uint32_t length;
+        std::uint32_t dist;
+    };
+
+private:
+    // The children of each slot: [slot * 2] is the smaller subtree, [slot * 2 + 1] the greater one
+    std::unique_ptr<pos_type[]> son_;
+    std::unique_ptr<pos_type[]> head4_;
+    std::unique_ptr<pos_type[]> head3_;
+
+    // The hash bits in use, see reset()
+    size_type hash4_bits_;
+    size_type hash3_bits_;
+
+public:
+    LZDictBinTree()
+        : son_(new pos_type[kCyclicSize * 2]),
+          head4_(new pos_type[kHash4Size]),
+          head3_(new pos_type[kHash3Size]),
+          hash4_bits_(kHash4Bits), hash3_bits_(kHash3Bits) {
+        clear();
+    }
+
+    ~LZDictBinTree() {
+        //
+    }
+
+    void clear() {
+        hash4_bits_ = kHash4Bits;
+        hash3_bits_ = kHash3Bits;
+        std::memset(son_.get(), 0xFF, kCyclicSize * 2 * sizeof(pos_type));
+        std::memset(head4_.get(), 0xFF, kHash4Size * sizeof(pos_type));
+        std::memset(head3_.get(), 0xFF, kHash3Size * sizeof(pos_type));
+    }
+
+    //
+    // Forget all the positions before a new data of data_size bytes, the hash
+    // tables use about one head per position, so only that part is cleared.
+    // The nodes needn't be cleared, a node is linked when it's inserted.
+    //
+    void reset(size_type data_size) {
+        size_type bits = kMinHashBits;
+        while ((bits < kHash4Bits) && ((static_cast<size_type>(1) << bits) < data_size))
+            bits++;
+        hash4_bits_ = bits;
+        hash3_bits_ = (bits < kHash3Bits) ? bits : kHash3Bits;
+        std::memset(head4_.get(), 0xFF, (static_cast<size_type>(1) << hash4_bits_) * sizeof(pos_type));
+        std::memset(head3_.get(), 0xFF, (static_cast<size_type>(1) << hash3_bits_) * sizeof(pos_type));
+    }
+
+    //
+    // Insert the position and write the matches of (data + pos) into matches,
+    // with the increasing lengths, return the number of matches.
+    //
+    // len_limit: the max match length, it must be >= kKeyLen,
+    //            and (pos + len_limit) must be within the data.
+    // max_depth: the max number of the tree nodes to visit.
+    //
+    // The array of matches needs room for (len_limit - kMinMatchLength + 1) items.
+    //
+    size_type find_matches(const LZByte * data, size_type pos, size_type len_limit,
+                           size_type max_depth, Match * matches) {
+        assert(len_limit >= kKeyLen);
+        const LZByte * cur = data + pos;
+        size_type num_matches = 0;
+        size_type best_len = kMinMatchLength - 1;
+
+        // The nearest 3-byte match, the 4-byte ones are in the tree
+        size_type hash3 = hash3_key(cur);
+        pos_type match3 = head3_[hash3];
+        head3_[hash3] = static_cast<pos_type>(pos);
+        if (match3 != kEmpty) {
+            size_type dist = pos - match3;
+            if (dist <= kMaxDistance) {
+                size_type len = lz_match_length(data + match3, cur, len_limit);
+                if (len >= kMinMatchLength) {
+                    matches[num_matches].length = static_cast<std::uint32_t>(len);
+                    matches[num_matches].dist = static_cast<std::uint32_t>(dist);
+                    num_matches++;
+                    best_len = len;
+                    if (len == len_limit) {
+                        // The tree still needs the new position
+                        insert_tree<false>(data, pos, len_limit, max_depth, matches, best_len);
+                        return num_matches;
+                    }
+                }
+            }
+        }
+
+        num_matches += insert_tree<true>(data, pos, len_limit, max_depth, matches + num_matches, best_len);
+        return num_matches;
+    }
+
+    //
+    // Insert the position without reporting the matches, it's used for
+    // the positions inside a match which has been chosen.
+    //
+    void skip(const LZByte * data, size_type pos, size_type len_limit, size_type max_depth) {
+        assert(len_limit >= kKeyLen);
+        head3_[hash3_key(data + pos)] = static_cast<pos_type>(pos);
+        size_type best_len = kMinMatchLength - 1;
+        insert_tree<false>(data, pos, len_limit, max_depth, nullptr, best_len);
+    }
+
+private:
+    static inline std::uint32_t read_key4(const LZByte * data) {
+        std::uint32_t key;
+        std::memcpy(&key, data, sizeof(key));
+        return key;
+    }
+
+    inline size_type hash3_key(const LZByte * data) const {
+        std::uint32_t key = static_cast<std::uint32_t>(data[0]) |
+                           (static_cast<std::uint32_t>(data[1]) << 8) |
+                           (static_cast<std::uint32_t>(data[2]) << 16);
+        return static_cast<size_type>((key * 2654435761u) >> (32 - hash3_bits_));
+    }
+
+    inline size_type hash4_key(const LZByte * data) const {
+        return static_cast<size_type>((read_key4(data) * 2654435761u) >> (32 - hash4_bits_));
+    }
+
+    //
+    // Walk down the tree of the hash from the root, re-link the visited nodes
+    // into the two subtrees of the new root (pos), and report the matches
+    // longer than best_len if NeedMatches.
+    //
+    template <bool NeedMatches>
+    size_type insert_tree(const LZByte * data, size_type pos, size_type len_limit,
+                          size_type max_depth, Match * matches, size_type & best_len) {
+        const LZByte * cur = data + pos;
+        size_type num_matches = 0;
+
+        size_type hash4 = hash4_key(cur);
+        pos_type cur_match = head4_[hash4];
+        head4_[hash4] = static_cast<pos_type>(pos);
+
+        pos_type * son = son_.get();
+        size_type cyclic_pos = pos % kCyclicSize;
+        // The slots to link the next smaller and greater nodes into
+        pos_type * ptr_smaller = son + cyclic_pos * 2;
+        pos_type * ptr_greater = son + cyclic_pos * 2 + 1;
+        // The common prefix lengths with the smaller and greater sides,
+        // every node below matches at least the shorter one of them
+        size_type len_smaller = 0, len_greater = 0;
+
+        for (size_type depth = max_depth; ; depth--) {
+            size_type dist = pos - static_cast<size_type>(cur_match);
+            if ((cur_match == kEmpty) || (dist > kMaxDistance) || (depth == 0)) {
+                *ptr_smaller = kEmpty;
+                *ptr_greater = kEmpty;
+                break;
+            }
+
+            // The slot of cur_match, dist back from cyclic_pos
+            size_type match_slot = (dist <= cyclic_pos) ? (cyclic_pos - dist) : (cyclic_pos + kCyclicSize - dist);
+            pos_type * pair = son + match_slot * 2;
+            const LZByte * match = data + cur_match;
+            size_type len = (len_smaller < len_greater) ? len_smaller : len_greater;
+            if (match[len] == cur[len]) {
+                len += lz_match_length(match + len, cur + len, len_limit - len);
+                if (NeedMatches && (len > best_len)) {
+                    best_len = len;
+                    matches[num_matches].length = static_cast<std::uint32_t>(len);
+                    matches[num_matches].dist = static_cast<std::uint32_t>(dist);
+                    num_matches++;
+                }
+                if (len >= len_limit) {
+                    // Equal within the limit: the new node takes the place of the old one
+                    *ptr_smaller = pair[0];
+                    *ptr_greater = pair[1];
+                    break;
+                }
+            }
+
+            if (match[len] < cur[len]) {
+                // The old string is smaller, it goes to the smaller side with its smaller subtree
+                *ptr_smaller = cur_match;
+                ptr_smaller = pair + 1;
+                cur_match = *ptr_smaller;
+                len_smaller = len;
+            } else {
+                *ptr_greater = cur_match;
+                ptr_greater = pair;
+                cur_match = *ptr_greater;
+                len_greater = len;
+            }
+        }
+
+        return num_matches;
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_LZ77_LZDICTBINTREE_HPP
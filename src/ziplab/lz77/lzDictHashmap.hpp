@@ -11,11 +11,19 @@
 #include <unordered_map>
 #include <memory>
 #include <stdexcept>
+#include <cstring>      // For std::memset()
 
 #include "ziplab/lz77/lz77.hpp"
 
 namespace ziplab {
 
+//
+// Hash chains of a sliding window: head_[hash] is the latest position whose
+// key has that hash, prev_[pos & kOffsetMask] is the previous position with
+// the same hash. The positions are truncated to offset_type, the caller gets
+// the distance as (pos - position) modulo (1 << (sizeof(T) * 8)) and must
+// verify the candidates, because the old entries are overwritten.
+//
 template <typename T, std::size_t SizeBits>
 class LZDictHashmap {
 public:
@@ -78,6 +86,20 @@ public:
         return *(head_ + offset);
     }
 
+    void clear() {
+        assert(prev_ != nullptr);
+        std::memset(prev_, 0, kCapacity * 2 * sizeof(offset_type));
+    }
+
+    // Insert the position into the chain of the hash, return the previous head.
+    offset_type insert(size_type hash, size_type pos) {
+        assert(hash < kCapacity);
+        offset_type prev_pos = head_[hash];
+        prev_[pos & kOffsetMask] = prev_pos;
+        head_[hash] = static_cast<offset_type>(pos);
+        return prev_pos;
+    }
+
 private:
     void init(size_type capacity) {
         assert(capacity > 0);
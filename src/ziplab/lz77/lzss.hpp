@@ -5,6 +5,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <climits>      // For CHAR_BIT
 #include <bitset>
 #include <vector>
 #include <string>
@@ -12,10 +13,14 @@
 #include <unordered_map>
 #include <memory>
 #include <stdexcept>
+#include <algorithm>    // For std::min(), std::max()
+#include <cstring>      // For std::memcpy()
 
+#include "ziplab/basic/stddef.h"
 #include "ziplab/jstd/bitset.hpp"
 #include "ziplab/lz77/lz77.hpp"
 #include "ziplab/lz77/lzDictHashmap.hpp"
+#include "ziplab/lz77/lzDictBinTree.hpp"
 
 #include "ziplab/stream/MemoryBuffer.h"
 #include "ziplab/stream/InputStream.h"
@@ -23,6 +28,16 @@
 
 namespace ziplab {
 
+//
+// Format:
+//   [content size: 4]
+//   [block: (token count: 4)(flags: (token count + 7) / 8)(tokens)] * N
+//
+// Each block covers kBlockDataSize bytes of input (the last one may be shorter),
+// the matches don't cross the end of a block. The flag bit i (LSB first) tells
+// whether the token i is a literal (0, 1 byte) or a match (1, a 2-byte packed
+// pair: ((length - kMinMatchLength) << kWindowBits) | (distance - 1)).
+//
 template <std::size_t WindowBits, std::size_t LookAheadBits>
 class LZSSCompressor {
 public:
@@ -46,6 +61,10 @@ public:
     // LookAheadBits >= 2, LookAheadSize >= 4
     static_assert((kLookAheadBits > 1), "The LookAheadBits must be greater than 1.");
 
+    // A packed pair (length, distance) is 16 bits
+    static_assert(((kWindowBits + kLookAheadBits) <= 16),
+                  "The WindowBits + LookAheadBits must be less than or equal to 16.");
+
     static constexpr size_type kWindowMask = kWindowSize - 1;
     static constexpr size_type kLengthMask = kLookAheadSize - 1;
 
@@ -56,6 +75,28 @@ public:
     static constexpr size_type kL1HashKeyLen = 3;
     static constexpr size_type kL2HashKeyLen = 6;
 
+    // The hash chains of the window, see LZDictHashmap
+    using hashmap_type = LZDictHashmap<offset_type, WindowBits>;
+    // The binary trees of the window for the high levels, see LZDictBinTree
+    using bintree_type = LZDictBinTree<WindowBits>;
+
+    static constexpr size_type kHashBits = kWindowBits;
+    static constexpr size_type kMaxDistance = (std::min)(kWindowSize, static_cast<size_type>(0xFFFF));
+
+    static_assert((bintree_type::kMaxDistance == kMaxDistance),
+                  "The match finders must agree on the max distance.");
+
+    // Compression levels: [kMinLevel, kMaxLevel]
+    static constexpr int kMinLevel = 1;
+    static constexpr int kMaxLevel = 9;
+    static constexpr int kDefaultLevel = 6;
+
+    // The parsers, kParseByLevel uses the parser of the compression level
+    static constexpr int kParseByLevel = 0;
+    static constexpr int kParseGreedy  = 1;
+    static constexpr int kParseLazy    = 2;
+    static constexpr int kParseOptimal = 3;
+
     //
     // The total data size of block, to adaptive the size of L1 or L2 cache.
     // We make the total data size of block less than or equal to 16 KB or 32 KB.
@@ -75,23 +116,106 @@ public:
     static_assert(((kBlockDataSize & (kBlockDataSize - 1)) == 0),
                   "The kBlockDataSize must be is a power of 2.");
 
-    // A flag is followed by 1 or 2 bytes of data.
-    static constexpr size_type kBlockFlagSize = kBlockDataSize / 2;
+    // A token covers at least 1 byte of input, so there is one flag per byte at most.
+    static constexpr size_type kBlockFlagSize = kBlockDataSize;
+
+    // The wild copies of the decompressor may write past the end of a match
+    static constexpr size_type kWildCopyMargin = 32;
 
     static constexpr size_type npos = static_cast<size_type>(-1);
 
 private:
     struct MatchResult {
         size_type match_len;
-        size_type match_pos;
+        // The distance back from the current position, [1, kMaxDistance]
+        size_type match_dist;
+
+        MatchResult() : match_len(0), match_dist(0) {}
+
+        MatchResult(size_type match_len, size_type match_dist)
+            : match_len(match_len), match_dist(match_dist) {}
+    };
 
-        MatchResult() : match_len(0), match_pos(npos) {}
+    // The search effort of each compression level
+    struct LevelConfig {
+        // The max number of the chain entries (or the tree nodes) to visit
+        size_type max_chain;
+        // Stop searching when a match is at least this long
+        size_type nice_length;
+        // Check the next position for a longer match (lazy matching),
+        // a match of nice_length or longer is taken at once
+        bool      lazy;
+        // Use the binary tree instead of the hash chains
+        bool      binary_tree;
+        // kParseGreedy, kParseLazy or kParseOptimal
+        int       parser;
+    };
 
-        MatchResult(size_type match_len, size_type match_pos)
-            : match_len(match_len), match_pos(match_pos) {}
+    //
+    // The prices of the optimal parser, in bits: a token costs its flag bit
+    // plus a literal byte or a packed pair.
+    //
+    static constexpr std::uint32_t kLiteralPrice = 1 + 8;
+    static constexpr std::uint32_t kMatchPrice   = 1 + 16;
+    static constexpr std::uint32_t kInfinitePrice = static_cast<std::uint32_t>(-1);
+
+    // The cheapest way found to reach a position of the block: the last token
+    struct Arrival {
+        // 1 is a literal
+        std::uint32_t length;
+        std::uint32_t dist;
+    };
 
-        MatchResult(const MatchResult & src)
-            : match_len(src.match_len), match_pos(src.match_pos) {
+    // The working set of the optimal parser, indexed by the offset in the block
+    struct OptimalState {
+        std::vector<std::uint32_t> prices;
+        std::vector<Arrival>       arrivals;
+        std::vector<Arrival>       path;
+
+        OptimalState() : prices(kBlockDataSize + 1), arrivals(kBlockDataSize + 1) {
+            path.reserve(kBlockDataSize);
+        }
+    };
+
+    // The tokens of a block: the flag bits and the literals and packed pairs
+    struct BlockWriter {
+        jstd::bitset<kBlockFlagSize> flag_bits;
+        MemoryBuffer block_data;
+        OutputStream block_os;
+        size_type    num_tokens;
+
+        BlockWriter() : block_os(block_data), num_tokens(0) {
+            // A token outputs at most 1 byte per byte of input
+            block_data.prepare(kBlockDataSize);
+        }
+
+        void literal(char ch) {
+            block_os.unsafeWriteChar(ch);
+            num_tokens++;
+        }
+
+        void match(const MatchResult & match_result) {
+            // A pair of (MatchLength, MatchDistance) - [length, distance]
+            PackedPair packedPair(match_result);
+            block_os.unsafeWriteByte(packedPair.parts.low);
+            block_os.unsafeWriteByte(packedPair.parts.high);
+            flag_bits.set(num_tokens);
+            num_tokens++;
+        }
+
+        // Output token count, flag bits and block data
+        void flush(OutputStream & compressed_os) {
+            size_type flag_bytes = (num_tokens + (CHAR_BIT - 1)) / CHAR_BIT;
+            // Allocate the size of data to be added in advance
+            compressed_os.reserve(compressed_os.size() + sizeof(std::uint32_t) + flag_bytes + block_data.size());
+
+            compressed_os.writeUInt32(static_cast<std::uint32_t>(num_tokens));
+            compressed_os.unsafeWrite(flag_bits.data(), flag_bytes);
+            compressed_os.unsafeWrite(block_data);
+
+            flag_bits.reset_part(flag_bytes);
+            block_data.clear();
+            num_tokens = 0;
         }
     };
 
@@ -129,9 +253,9 @@ private:
 
         static std::uint16_t make_pair(const MatchResult & result) {
             size_type match_len = result.match_len - kMinMatchLength;
-            assert(match_len < kMaxMatchLength);
-            assert(result.match_pos < kWindowSize);
-            return make_pair(match_len, result.match_pos);
+            assert(match_len <= kMaxMatchLength);
+            assert(result.match_dist > 0 && result.match_dist <= kWindowSize);
+            return make_pair(match_len, result.match_dist - 1);
         }
 
         static std::uint16_t make_pair(size_type match_len, size_type match_pos) {
@@ -143,81 +267,90 @@ private:
     #pragma GCC diagnostic pop
 #endif
 
+    int level_;
+    int parser_;
+
+    // The match finders are kept by the next calls, they're created when first used
+    std::unique_ptr<hashmap_type> hashmap_;
+    std::unique_ptr<bintree_type> bintree_;
+
 public:
-    LZSSCompressor() {
-        //
+    LZSSCompressor(int level = kDefaultLevel, int parser = kParseByLevel)
+        : level_(kDefaultLevel), parser_(kParseByLevel) {
+        setLevel(level);
+        setParser(parser);
     }
 
     ~LZSSCompressor() {
         //
     }
 
+    int level() const {
+        return level_;
+    }
+
+    void setLevel(int level) {
+        level_ = (std::max)(kMinLevel, (std::min)(level, kMaxLevel));
+    }
+
+    int parser() const {
+        return parser_;
+    }
+
+    //
+    // Override the parser of the level: kParseGreedy, kParseLazy or kParseOptimal,
+    // the search effort still comes from the level.
+    //
+    void setParser(int parser) {
+        parser_ = (parser >= kParseGreedy && parser <= kParseOptimal) ? parser : kParseByLevel;
+    }
+
     // Compress data
     int plain_compress(const std::string & input_data, MemoryBuffer & compressed_data) {
-        static constexpr size_type kWordBytes = sizeof(size_type);
-        static constexpr size_type kWordBits = kWordBytes * CHAR_BIT;
-        static constexpr size_type kMaxFlag = static_cast<size_type>(1) << (kWordBits - 1);
-        static constexpr size_type kBlockFlagBytes = (kBlockFlagSize + kWordBytes - 1) /  kWordBytes;
-
         int err_code = 0;
         OutputStream compressed_os(compressed_data);
 
         size_type data_size = input_data.size();
         if (ziplab_likely(data_size != 0)) {
-            //LZDictHashmap<offset_type, WindowBits> L1_hashmap;
+            const LevelConfig config = effective_config();
+            const char * data = input_data.data();
+
+            if (config.binary_tree) {
+                if (!bintree_)
+                    bintree_.reset(new bintree_type);
+                bintree_->reset(data_size);
+            } else {
+                if (!hashmap_)
+                    hashmap_.reset(new hashmap_type);
+                hashmap_->clear();
+            }
 
-            jstd::bitset<kBlockFlagSize> flag_bits;
-            MemoryBuffer block_data;
-            OutputStream block_os(block_data);
+            std::unique_ptr<BlockWriter> writer(new BlockWriter);
+            std::unique_ptr<OptimalState> optimal;
+            if (config.parser == kParseOptimal)
+                optimal.reset(new OptimalState);
 
-            block_data.prepare(kBlockDataSize);
+            // Write the content size
+            compressed_os.writeUInt32(static_cast<std::uint32_t>(data_size));
 
             size_type pos = 0;
             assert(data_size > 0);
             do {
                 size_type remaining_size = data_size - pos;
                 size_type block_capacity = (remaining_size > kBlockDataSize) ? kBlockDataSize : remaining_size;
-                size_type block_pos = pos;
                 size_type block_end = pos + block_capacity;
-                while (block_pos < block_end) {
-                    // Calculate the boundary of the sliding window.
-                    ssize_type window_first = block_pos - kWindowSize;  // It's can be negative
-                    size_type window_start = (window_first >= 0) ? window_first : 0;
-                    size_type window_size = (std::min)(kWindowSize, block_pos);
-                    size_type lookahead_size = (std::min)(kMaxLookAheadSize, data_size - block_pos);
-                    size_type lookahead_last = (std::min)(pos + kMaxLookAheadSize, data_size);
-
-                    const char * window = input_data.data() + window_start;
-                    const char * lookahead = input_data.data() + block_pos;
-
-                    MatchResult match_result = plain_find_match(window, lookahead, window_size, lookahead_size);
-                    if (ziplab_likely(match_result.match_len < kMinMatchLength)) {
-                        // Literal
-                        block_os.unsafeWriteByte(input_data[block_pos++]);
-                        block_os.unsafeWriteByte(input_data[block_pos++]);
-                    } else {
-                        // A pair of (MatchPos, MatchLength) - [distance, length]
-                        PackedPair packedPair(match_result);
-                        block_os.unsafeWriteByte(packedPair.parts.low);
-                        block_os.unsafeWriteByte(packedPair.parts.high);
-
-                        assert(match_result.match_pos != npos);
-                        flag_bits.set(block_pos);
-
-                        block_pos += match_result.match_len;
-                    }
-                }
-
-                // Output flag bits and block data
-                size_type flag_bytes = (block_capacity + (CHAR_BIT - 1)) / CHAR_BIT;
-                // Allocate the size of data to be added in advance
-                compressed_os.grow(flag_bytes + block_capacity);
 
-                compressed_os.unsafeWrite(flag_bits.data(), flag_bytes);
-                compressed_os.unsafeWrite(block_data);
+                if (config.parser == kParseOptimal) {
+                    parse_block_optimal(*bintree_, data, data_size, pos, block_end, config, *optimal, *writer);
+                } else if (config.binary_tree) {
+                    BinTreeFinder finder(*bintree_, data, data_size, config);
+                    parse_block_lazy(finder, data, pos, block_end, config, *writer);
+                } else {
+                    HashChainFinder finder(*hashmap_, data, data_size, config);
+                    parse_block_lazy(finder, data, pos, block_end, config, *writer);
+                }
 
-                flag_bits.reset_part(flag_bytes);
-                block_data.clear();
+                writer->flush(compressed_os);
 
                 pos = block_end;
             } while (pos < data_size);
@@ -230,8 +363,49 @@ public:
     int plain_decompress(const MemoryBuffer & compressed_data, MemoryBuffer & decompressed_data) {
         int err_code = 0;
 
-        OutputStream decompressed(decompressed_data);
-        ZIPLAB_UNUSED(compressed_data);
+        size_type data_size = compressed_data.size();
+        if (ziplab_likely(data_size != 0)) {
+            const LZByte * input = reinterpret_cast<const LZByte *>(compressed_data.data());
+            const LZByte * input_end = input + data_size;
+
+            // Read the content size
+            if (data_size < sizeof(std::uint32_t))
+                return -1;
+            size_type content_size = read_uint32(input);
+            input += sizeof(std::uint32_t);
+
+            // The wild copies may write kWildCopyMargin bytes past the end of content
+            decompressed_data.reserve(decompressed_data.size() + content_size + kWildCopyMargin);
+
+            LZByte * out_first = reinterpret_cast<LZByte *>(decompressed_data.current());
+            LZByte * out_end = out_first + content_size;
+            LZByte * out = out_first;
+
+            while (out < out_end) {
+                // Read the token count and the flag bits of block
+                if ((input_end - input) < static_cast<ssize_type>(sizeof(std::uint32_t)))
+                    return -1;
+                size_type num_tokens = read_uint32(input);
+                input += sizeof(std::uint32_t);
+
+                size_type flag_bytes = (num_tokens + (CHAR_BIT - 1)) / CHAR_BIT;
+                if ((num_tokens == 0) || (num_tokens > kBlockFlagSize) ||
+                    (static_cast<size_type>(input_end - input) < flag_bytes))
+                    return -1;
+                const LZByte * flags = input;
+                input += flag_bytes;
+
+                out = decompress_block(flags, num_tokens, input, input_end, out_first, out, out_end);
+                if (ziplab_unlikely(out == nullptr))
+                    return -1;
+            }
+
+            // All the input must be consumed exactly
+            if (input != input_end)
+                return -1;
+
+            decompressed_data.forward(content_size);
+        }
 
         return err_code;
     }
@@ -247,6 +421,140 @@ public:
     }
 
 private:
+    static inline size_type read_uint32(const LZByte * input) {
+        std::uint32_t value;
+        std::memcpy(&value, input, sizeof(value));
+        return static_cast<size_type>(value);
+    }
+
+    //
+    // Copy a match of length bytes from (out - dist), in chunks of 16 or 8 bytes,
+    // it may write up to kWildCopyMargin bytes past (out + length).
+    //
+    // The chunks overlap the bytes being written when the distance is below 8,
+    // then the period of the match is repeated in a 64-bit pattern instead, and
+    // stored at the steps of the largest multiple of the distance not above 8.
+    //
+    static ZIPLAB_FORCED_INLINE
+    void wild_copy_match(LZByte * out, size_type dist, size_type length) {
+        const LZByte * src = out - dist;
+        LZByte * const out_end = out + length;
+        if (ziplab_likely(dist >= 16)) {
+            do {
+                std::memcpy(out, src, 16);
+                out += 16;
+                src += 16;
+            } while (out < out_end);
+        } else if (dist >= 8) {
+            do {
+                std::memcpy(out, src, 8);
+                out += 8;
+                src += 8;
+            } while (out < out_end);
+        } else {
+#if (ZIPLAB_ENDIAN == ZIPLAB_LITTLE_ENDIAN)
+            static const std::uint8_t kPatternStep[8] = { 0, 8, 8, 6, 8, 5, 6, 7 };
+
+            // Only the first dist bytes of src have been written
+            std::uint64_t pattern;
+            std::memcpy(&pattern, src, sizeof(pattern));
+            pattern &= (~std::uint64_t(0)) >> ((8 - dist) * 8);
+            for (size_type period = dist; period < 8; period *= 2) {
+                pattern |= pattern << (period * 8);
+            }
+
+            size_type step = kPatternStep[dist];
+            do {
+                std::memcpy(out, &pattern, sizeof(pattern));
+                out += step;
+            } while (out < out_end);
+#else
+            do {
+                *out++ = *src++;
+            } while (out < out_end);
+#endif
+        }
+    }
+
+    //
+    // Decode the tokens of one block, return the new output position,
+    // or nullptr if the data is corrupted.
+    //
+    LZByte * decompress_block(const LZByte * flags, size_type num_tokens,
+                              const LZByte *& input, const LZByte * input_end,
+                              const LZByte * out_first, LZByte * out, const LZByte * out_end) {
+        // The most input and output of a group of 8 tokens, plus the wild literal copies
+        static constexpr ssize_type kMaxGroupInput = 8 * 2 + 8;
+        static constexpr ssize_type kMaxGroupOutput = 8 * kMaxLookAheadSize + 8;
+
+        const LZByte * ip = input;
+        size_type token = 0;
+
+        //
+        // Fast path: whole groups of 8 tokens, far enough from the input and output ends.
+        // The literals before each match are copied as one run of 8 bytes (wild copy),
+        // the bit scan of the flags skips them without a branch per literal.
+        //
+        size_type num_groups = num_tokens / CHAR_BIT;
+        for (size_type group = 0; group < num_groups; group++) {
+            if (ziplab_unlikely(((input_end - ip) < kMaxGroupInput) || ((out_end - out) < kMaxGroupOutput)))
+                break;
+
+            std::uint32_t flag = flags[group];
+            size_type remaining = CHAR_BIT;
+            while (flag != 0) {
+                // The literals before the next match
+                size_type num_literals = lz_count_trailing_zeros64(flag);
+                std::memcpy(out, ip, 8);
+                out += num_literals;
+                ip += num_literals;
+
+                size_type pair = static_cast<size_type>(ip[0]) | (static_cast<size_type>(ip[1]) << 8);
+                ip += 2;
+                size_type dist = (pair & kWindowMask) + 1;
+                size_type length = (pair >> kWindowBits) + kMinMatchLength;
+                if (ziplab_unlikely(dist > static_cast<size_type>(out - out_first)))
+                    return nullptr;
+                wild_copy_match(out, dist, length);
+                out += length;
+
+                flag >>= (num_literals + 1);
+                remaining -= (num_literals + 1);
+            }
+
+            // The literals after the last match
+            std::memcpy(out, ip, 8);
+            out += remaining;
+            ip += remaining;
+
+            token += CHAR_BIT;
+        }
+
+        // Safe path: the remaining tokens, check each one
+        for (; token < num_tokens; token++) {
+            if ((flags[token / CHAR_BIT] & (1u << (token % CHAR_BIT))) == 0) {
+                if (ziplab_unlikely((ip >= input_end) || (out >= out_end)))
+                    return nullptr;
+                *out++ = *ip++;
+            } else {
+                if (ziplab_unlikely((input_end - ip) < 2))
+                    return nullptr;
+                size_type pair = static_cast<size_type>(ip[0]) | (static_cast<size_type>(ip[1]) << 8);
+                ip += 2;
+                size_type dist = (pair & kWindowMask) + 1;
+                size_type length = (pair >> kWindowBits) + kMinMatchLength;
+                if (ziplab_unlikely((dist > static_cast<size_type>(out - out_first)) ||
+                                    (length > static_cast<size_type>(out_end - out))))
+                    return nullptr;
+                wild_copy_match(out, dist, length);
+                out += length;
+            }
+        }
+
+        input = ip;
+        return out;
+    }
+
     inline size_type unsafe_output_flag_bits(OutputStream & compressedOs,
                                              const jstd::bitset<kBlockFlagSize> & flag_bits,
                                              size_type flag_capacity) {
@@ -275,51 +583,296 @@ private:
         return num_bytes;
     }
 
-    MatchResult plain_find_match(const char * window, const char * lookahead,
-                                 size_type window_size, size_type lookahead_size) {
-        assert(window != nullptr);
-        assert(lookahead != nullptr);
+    static const LevelConfig & level_config(int level) {
+        static const LevelConfig configs[kMaxLevel - kMinLevel + 1] = {
+            {    4,  8, false, false, kParseGreedy  },   // Level 1
+            {    8, 12, false, false, kParseGreedy  },   // Level 2
+            {   16, 16, false, false, kParseGreedy  },   // Level 3
+            {   16, kMaxLookAheadSize, true,  false, kParseLazy    },   // Level 4
+            {   32, kMaxLookAheadSize, true,  false, kParseLazy    },   // Level 5
+            {   64, kMaxLookAheadSize, true,  false, kParseLazy    },   // Level 6
+            {  256, kMaxLookAheadSize, true,  false, kParseLazy    },   // Level 7
+            {   16, kMaxLookAheadSize, false, true,  kParseOptimal },   // Level 8
+            {  128, kMaxLookAheadSize, false, true,  kParseOptimal },   // Level 9
+        };
+        assert(level >= kMinLevel && level <= kMaxLevel);
+        return configs[level - kMinLevel];
+    }
 
-        if (window_size < (kMinMatchLength - 1)) {
-            return { 0, 0 };
+    // The config of the level, with the parser overridden by setParser()
+    LevelConfig effective_config() const {
+        LevelConfig config = level_config(level_);
+        if (parser_ == kParseGreedy) {
+            config.parser = kParseGreedy;
+            config.lazy = false;
+        } else if (parser_ == kParseLazy) {
+            config.parser = kParseLazy;
+            config.lazy = true;
+        } else if (parser_ == kParseOptimal) {
+            // The optimal parser needs all the matches of each position, from the tree
+            config.parser = kParseOptimal;
+            config.binary_tree = true;
         }
+        return config;
+    }
 
-        assert(window_size > 0);
-        assert(lookahead_size > 0);
+    // Hash of the kL1HashKeyLen (3) bytes at data.
+    static inline size_type hash_key(const char * data) {
+        std::uint32_t key = static_cast<std::uint32_t>(static_cast<LZByte>(data[0])) |
+                           (static_cast<std::uint32_t>(static_cast<LZByte>(data[1])) << 8) |
+                           (static_cast<std::uint32_t>(static_cast<LZByte>(data[2])) << 16);
+        return static_cast<size_type>((key * 2654435761u) >> (32 - kHashBits));
+    }
 
-        size_type best_match_len = kMinMatchLength - 1;
-        size_type best_offset = npos;
+    //
+    // The match finders of parse_block_lazy():
+    //
+    //   find(pos, block_end): insert pos, return the best match at pos within the block,
+    //   skip(pos): insert pos only.
+    //
+    // Every position of the data is inserted once, in order.
+    //
+    struct HashChainFinder {
+        hashmap_type &      hashmap;
+        const char *        data;
+        size_type           data_size;
+        const LevelConfig & config;
+
+        HashChainFinder(hashmap_type & hashmap, const char * data, size_type data_size,
+                        const LevelConfig & config)
+            : hashmap(hashmap), data(data), data_size(data_size), config(config) {}
+
+        MatchResult find(size_type pos, size_type block_end) {
+            MatchResult match_result;
+            if (ziplab_likely((pos + kL1HashKeyLen) <= data_size)) {
+                // The matches don't cross the end of block.
+                size_type lookahead_size = (std::min)(kMaxLookAheadSize, block_end - pos);
+                size_type hash = hash_key(data + pos);
+                if (lookahead_size >= kMinMatchLength)
+                    match_result = find_match(data, pos, lookahead_size, hashmap, hash, config);
+                hashmap.insert(hash, pos);
+            }
+            return match_result;
+        }
 
-        for (size_type pos = 0; pos < window_size; pos++) {
-            const char * window_start = window + pos;
+        void skip(size_type pos) {
+            if (ziplab_likely((pos + kL1HashKeyLen) <= data_size)) {
+                hashmap.insert(hash_key(data + pos), pos);
+            }
+        }
+    };
 
-            size_type match_len = 0;
-            do  {
-                if (window_start[match_len] == lookahead[match_len])
-                    match_len++;
-                else
-                    break;
-            } while (match_len < lookahead_size && match_len < window_size);
+    struct BinTreeFinder {
+        bintree_type &      bintree;
+        const LZByte *      data;
+        size_type           data_size;
+        const LevelConfig & config;
+        typename bintree_type::Match matches[kMaxLookAheadSize];
+
+        BinTreeFinder(bintree_type & bintree, const char * data, size_type data_size,
+                      const LevelConfig & config)
+            : bintree(bintree), data(reinterpret_cast<const LZByte *>(data)),
+              data_size(data_size), config(config) {}
+
+        // Take the longest match
+        MatchResult find(size_type pos, size_type block_end) {
+            MatchResult match_result;
+            // The tree is built with the whole lookahead, the matches are clipped to the block
+            size_type len_limit = (std::min)(kMaxLookAheadSize, data_size - pos);
+            if (ziplab_likely(len_limit >= bintree_type::kKeyLen)) {
+                size_type num_matches = bintree.find_matches(data, pos, len_limit, config.max_chain, matches);
+                if (num_matches != 0) {
+                    const typename bintree_type::Match & longest = matches[num_matches - 1];
+                    match_result.match_len = (std::min)(static_cast<size_type>(longest.length), block_end - pos);
+                    match_result.match_dist = longest.dist;
+                }
+            }
+            return match_result;
+        }
 
-            if (match_len > best_match_len) {
-                best_match_len = match_len;
-                best_offset = pos;
+        void skip(size_type pos) {
+            size_type len_limit = (std::min)(kMaxLookAheadSize, data_size - pos);
+            if (ziplab_likely(len_limit >= bintree_type::kKeyLen)) {
+                bintree.skip(data, pos, len_limit, config.max_chain);
+            }
+        }
+    };
 
-                // If the matching length has reached the maximum lookahead size, return directly.
-                if (match_len >= lookahead_size)
+    //
+    // Greedy or lazy parsing of a block.
+    //
+    // With config.lazy, the next position is checked before a match is taken.
+    // Deferring the match costs a literal (kLiteralPrice), a longer match there
+    // pays for it, because the bytes it covers beyond the current match cost
+    // the current parse two literals or another match. Then the position after
+    // the longer match is checked in turn. A match k > 1 bytes later would pay
+    // k literals, more than kMatchPrice, so the farther positions aren't checked.
+    //
+    template <typename Finder>
+    void parse_block_lazy(Finder & finder, const char * data,
+                          size_type block_start, size_type block_end,
+                          const LevelConfig & config, BlockWriter & writer) {
+        size_type block_pos = block_start;
+        MatchResult match_result = finder.find(block_pos, block_end);
+        while (block_pos < block_end) {
+            if (ziplab_likely(match_result.match_len < kMinMatchLength)) {
+                writer.literal(data[block_pos++]);
+                if (block_pos < block_end)
+                    match_result = finder.find(block_pos, block_end);
+                continue;
+            }
+
+            // The last position which has been inserted
+            size_type match_pos = block_pos;
+            size_type probe_pos = block_pos;
+            while (config.lazy &&
+                   (match_result.match_len < config.nice_length) &&
+                   ((probe_pos + 1) < block_end)) {
+                probe_pos++;
+                MatchResult next_match = finder.find(probe_pos, block_end);
+                if (next_match.match_len > match_result.match_len) {
+                    match_result = next_match;
+                    match_pos = probe_pos;
+                } else {
                     break;
+                }
+            }
+
+            for (; block_pos < match_pos; block_pos++) {
+                writer.literal(data[block_pos]);
+            }
+            writer.match(match_result);
+
+            // Insert the rest of positions inside the match
+            size_type match_end = match_pos + match_result.match_len;
+            for (probe_pos++; probe_pos < match_end; probe_pos++) {
+                finder.skip(probe_pos);
+            }
+            block_pos = match_end;
+
+            if (block_pos < block_end)
+                match_result = finder.find(block_pos, block_end);
+        }
+    }
+
+    //
+    // Optimal parsing of a block, by the forward arrivals: walking the positions
+    // in order, each token which starts at a position offers a new price to
+    // the position where it ends, a literal to the next one and a match to
+    // every length up to its length. All the matches of the tree are used, the
+    // shortest (nearest) one which is long enough serves each length. Then the
+    // cheapest path is traced back from the end of block.
+    //
+    void parse_block_optimal(bintree_type & bintree, const char * data, size_type data_size,
+                             size_type block_start, size_type block_end, const LevelConfig & config,
+                             OptimalState & state, BlockWriter & writer) {
+        const LZByte * bytes = reinterpret_cast<const LZByte *>(data);
+        typename bintree_type::Match matches[kMaxLookAheadSize];
+
+        size_type block_size = block_end - block_start;
+        std::uint32_t * prices = state.prices.data();
+        Arrival * arrivals = state.arrivals.data();
+
+        prices[0] = 0;
+        for (size_type i = 1; i <= block_size; i++) {
+            prices[i] = kInfinitePrice;
+        }
+
+        for (size_type i = 0; i < block_size; i++) {
+            size_type pos = block_start + i;
+            std::uint32_t price = prices[i];
+            assert(price != kInfinitePrice);
+
+            std::uint32_t literal_price = price + kLiteralPrice;
+            if (literal_price < prices[i + 1]) {
+                prices[i + 1] = literal_price;
+                arrivals[i + 1].length = 1;
+                arrivals[i + 1].dist = 0;
             }
+
+            // The tree is built with the whole lookahead, the matches are clipped to the block
+            size_type len_limit = (std::min)(kMaxLookAheadSize, data_size - pos);
+            if (ziplab_unlikely(len_limit < bintree_type::kKeyLen))
+                continue;
+
+            size_type num_matches = bintree.find_matches(bytes, pos, len_limit, config.max_chain, matches);
+            size_type max_len = block_end - pos;
+            std::uint32_t match_price = price + kMatchPrice;
+            size_type length = kMinMatchLength;
+            for (size_type n = 0; n < num_matches; n++) {
+                size_type match_len = (std::min)(static_cast<size_type>(matches[n].length), max_len);
+                for (; length <= match_len; length++) {
+                    if (match_price < prices[i + length]) {
+                        prices[i + length] = match_price;
+                        arrivals[i + length].length = static_cast<std::uint32_t>(length);
+                        arrivals[i + length].dist = matches[n].dist;
+                    }
+                }
+            }
+        }
+
+        // Trace back the cheapest path
+        std::vector<Arrival> & path = state.path;
+        path.clear();
+        for (size_type i = block_size; i > 0; ) {
+            const Arrival & arrival = arrivals[i];
+            path.push_back(arrival);
+            assert(arrival.length != 0 && arrival.length <= i);
+            i -= arrival.length;
         }
 
-        return { best_match_len, best_offset };
+        size_type block_pos = block_start;
+        for (auto iter = path.rbegin(); iter != path.rend(); ++iter) {
+            if (iter->length == 1) {
+                writer.literal(data[block_pos]);
+            } else {
+                writer.match(MatchResult(iter->length, iter->dist));
+            }
+            block_pos += iter->length;
+        }
+        assert(block_pos == block_end);
     }
 
-    MatchResult find_match(const char * window, const char * lookahead,
-                           size_type window_size, size_type lookahead_size) {
+    //
+    // Walk the hash chain of the hash, from the nearest candidate,
+    // the chain ends when the distance stops growing or leaves the window.
+    //
+    static MatchResult find_match(const char * data, size_type pos, size_type lookahead_size,
+                                  const hashmap_type & hashmap, size_type hash, const LevelConfig & config) {
+        static constexpr size_type kOffsetMask = static_cast<offset_type>(-1);
+
+        assert(lookahead_size >= kMinMatchLength);
+        const char * lookahead = data + pos;
+        size_type nice_length = (std::min)(config.nice_length, lookahead_size);
+
         size_type best_match_len = kMinMatchLength - 1;
-        size_type best_offset = npos;
+        size_type best_dist = 0;
+
+        size_type candidate = hashmap.head(static_cast<offset_type>(hash));
+        size_type last_dist = 0;
+        for (size_type chain = config.max_chain; chain > 0; chain--) {
+            size_type dist = (pos - candidate) & kOffsetMask;
+            if (dist <= last_dist || dist > kMaxDistance || dist > pos)
+                break;
+            last_dist = dist;
+
+            const char * match = lookahead - dist;
+            // Only a longer match is interesting, check its last byte first
+            if (match[best_match_len] == lookahead[best_match_len]) {
+                size_type match_len = lz_match_length(reinterpret_cast<const LZByte *>(match),
+                                                      reinterpret_cast<const LZByte *>(lookahead),
+                                                      lookahead_size);
+                if (match_len > best_match_len) {
+                    best_match_len = match_len;
+                    best_dist = dist;
+                    if (match_len >= nice_length)
+                        break;
+                }
+            }
+            candidate = hashmap.prev(static_cast<offset_type>(candidate));
+        }
 
-        return { best_match_len, best_offset };
+        return { best_match_len, best_dist };
     }
 };
 
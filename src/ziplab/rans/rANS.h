@@ -7,9 +7,47 @@
 #include <cstddef>
 
 #include <vector>
+#include <algorithm>    // For std::sort(), std::make_heap()
+#include <type_traits>  // For std::is_unsigned<T>
+
+#include <assert.h>
+
+#include "ziplab/basic/stddef.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>     // For __umulh()
+#endif
 
 namespace ziplab {
 
+//
+// The parameters of a rANS coder:
+//
+//   ScaleBits: the probability scale is (1 << ScaleBits), from 10 to 16.
+//   StateT:    the type of the states, std::uint64_t or std::uint32_t.
+//   WordT:     the renormalization unit, the states are kept in the interval
+//              [kLowerBound, kLowerBound << kWordBits).
+//
+template <std::size_t ScaleBits, typename StateT, typename WordT>
+struct rANSTraits {
+    using state_type = StateT;
+    using word_type  = WordT;
+
+    static const std::size_t   kScaleBits  = ScaleBits;
+    static const std::uint32_t kTotalFreq  = std::uint32_t(1) << ScaleBits;
+    static const std::uint32_t kScaleMask  = kTotalFreq - 1;
+    static const std::size_t   kStateBits  = sizeof(StateT) * 8;
+    static const std::size_t   kWordBits   = sizeof(WordT) * 8;
+    static const StateT        kLowerBound = StateT(1) << (kStateBits - 1 - kWordBits);
+
+    static_assert((ScaleBits >= 10 && ScaleBits <= 16),
+                  "rANSTraits: ScaleBits must be in [10, 16]");
+    static_assert(std::is_unsigned<StateT>::value && std::is_unsigned<WordT>::value,
+                  "rANSTraits: StateT and WordT must be unsigned integer types");
+    static_assert((kWordBits < kStateBits - 1) && ((kStateBits - 1 - kWordBits) >= ScaleBits),
+                  "rANSTraits: kLowerBound must be greater than or equal to kTotalFreq");
+};
+
 static const std::size_t kSymbolTotal = 256;
 static const std::size_t kMaxSymbol = kSymbolTotal - 1;
 
@@ -26,8 +64,8 @@ struct SymbolStat {
     std::uint32_t freq;
     std::uint32_t cumul;
 
-    // Fast div
-    std::uint32_t inverse;
+    // Fast div, see rANSReciprocal
+    std::uint64_t inverse;
     std::uint32_t bias;
     std::uint32_t shift;
 
@@ -55,6 +93,274 @@ struct SymbolStats {
     }
 };
 
+//
+// The high 64 bits of the 128-bit product (a * b).
+//
+static inline
+std::uint64_t mul_hi64(std::uint64_t a, std::uint64_t b)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return __umulh(a, b);
+#elif defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128_t;
+    return static_cast<std::uint64_t>((static_cast<uint128_t>(a) * b) >> 64);
+#else
+    std::uint64_t a_lo = a & 0xFFFFFFFFull, a_hi = a >> 32;
+    std::uint64_t b_lo = b & 0xFFFFFFFFull, b_hi = b >> 32;
+    std::uint64_t lo_lo = a_lo * b_lo;
+    std::uint64_t hi_lo = a_hi * b_lo;
+    std::uint64_t lo_hi = a_lo * b_hi;
+    std::uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFull) + lo_hi;
+    return (a_hi * b_hi) + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+//
+// Division-free encoding (Alverson, "Integer Division using reciprocals"):
+//
+//   quotient(state) == state / freq, for any state < 2^(kStateBits - 1),
+//
+// then the encoder computes (state / freq) * M + (state % freq) + cumul as
+//
+//   state + bias + quotient(state) * (M - freq).
+//
+// For freq = 1, the inverse is all ones and the bias is (cumul + M - 1),
+// so that quotient(state) = state - 1 gives the same result.
+//
+template <typename StateT>
+struct rANSReciprocal;
+
+template <>
+struct rANSReciprocal<std::uint32_t> {
+    static void init(SymbolStat & stat, std::uint32_t scale_bits) {
+        std::uint32_t freq = stat.freq;
+        assert(freq != 0);
+        if (freq < 2) {
+            stat.inverse = 0xFFFFFFFFu;
+            stat.shift = 0;
+            stat.bias = stat.cumul + (1u << scale_bits) - 1;
+        } else {
+            std::uint32_t shift = 0;
+            while (freq > (1u << shift)) {
+                shift++;
+            }
+            stat.inverse = ((std::uint64_t(1) << (shift + 31)) + freq - 1) / freq;
+            stat.shift = shift - 1;
+            stat.bias = stat.cumul;
+        }
+        stat.shift += 32;
+    }
+
+    static ZIPLAB_FORCED_INLINE
+    std::uint32_t quotient(std::uint32_t state, const SymbolStat & stat) {
+        return static_cast<std::uint32_t>((static_cast<std::uint64_t>(state) * stat.inverse) >> stat.shift);
+    }
+};
+
+template <>
+struct rANSReciprocal<std::uint64_t> {
+    static void init(SymbolStat & stat, std::uint32_t scale_bits) {
+        std::uint32_t freq = stat.freq;
+        assert(freq != 0);
+        if (freq < 2) {
+            stat.inverse = ~std::uint64_t(0);
+            stat.shift = 0;
+            stat.bias = stat.cumul + (1u << scale_bits) - 1;
+        } else {
+            std::uint32_t shift = 0;
+            while (freq > (1u << shift)) {
+                shift++;
+            }
+            // The 64-bit reciprocal needs a 96 / 32 bits division, in two steps
+            std::uint64_t x0 = freq - 1;
+            std::uint64_t x1 = std::uint64_t(1) << (shift + 31);
+            std::uint64_t t1 = x1 / freq;
+            x0 += (x1 % freq) << 32;
+            std::uint64_t t0 = x0 / freq;
+            stat.inverse = t0 + (t1 << 32);
+            stat.shift = shift - 1;
+            stat.bias = stat.cumul;
+        }
+    }
+
+    static ZIPLAB_FORCED_INLINE
+    std::uint64_t quotient(std::uint64_t state, const SymbolStat & stat) {
+        return (mul_hi64(state, stat.inverse) >> stat.shift);
+    }
+};
+
+//
+// Normalize the symbol frequencies so that they sum up to total_freq,
+// every present symbol keeps a frequency of at least 1.
+// It fills the freq and cumul of stats.symbols[0, freq_size], the symbol range
+// and the total_freq, return false if there is no symbol or too many symbols.
+//
+// It uses the largest remainder method: each symbol gets the floor of its
+// share, the missing units go to the largest remainders. If raising the rare
+// symbols to 1 overshoots, the units are taken back from the symbols which
+// lose the fewest bits. Both steps are O(n log n) in the number of symbols.
+//
+static inline
+bool normalize_symbol_stats(SymbolStats & stats, const std::uint32_t * freqs,
+                            std::size_t freq_size, std::uint32_t total_freq)
+{
+    assert(stats.symbols.size() > freq_size);
+    assert(freq_size <= kSymbolTotal);
+
+    std::uint64_t sum_freq = 0;
+    std::uint32_t present[kSymbolTotal];
+    std::size_t num_symbols = 0;
+    for (std::size_t i = 0; i < freq_size; i++) {
+        if (freqs[i] != 0) {
+            sum_freq += freqs[i];
+            present[num_symbols++] = static_cast<std::uint32_t>(i);
+        }
+    }
+    if (num_symbols == 0 || num_symbols > total_freq)
+        return false;
+
+    stats.min_symbol = static_cast<std::uint8_t>(present[0]);
+    stats.max_symbol = static_cast<std::uint8_t>(present[num_symbols - 1]);
+
+    // Floor of the share, the present symbols get at least 1
+    std::uint64_t remainders[kSymbolTotal];
+    std::uint32_t scaled_total = 0;
+    for (std::size_t i = 0; i < freq_size; i++) {
+        stats.symbols[i].freq = 0;
+    }
+    for (std::size_t n = 0; n < num_symbols; n++) {
+        std::uint32_t symbol = present[n];
+        std::uint64_t scaled = static_cast<std::uint64_t>(freqs[symbol]) * total_freq;
+        std::uint32_t freq = static_cast<std::uint32_t>(scaled / sum_freq);
+        if (freq != 0) {
+            remainders[symbol] = scaled % sum_freq;
+        } else {
+            freq = 1;
+            remainders[symbol] = 0;
+        }
+        stats.symbols[symbol].freq = freq;
+        scaled_total += freq;
+    }
+
+    if (scaled_total < total_freq) {
+        // Each symbol lost less than one unit, so the deficit is less than num_symbols
+        std::sort(present, present + num_symbols,
+            [&remainders](std::uint32_t lhs, std::uint32_t rhs) {
+                return (remainders[lhs] > remainders[rhs]) ||
+                       ((remainders[lhs] == remainders[rhs]) && (lhs < rhs));
+            });
+        std::uint32_t deficit = total_freq - scaled_total;
+        assert(deficit < num_symbols);
+        for (std::uint32_t n = 0; n < deficit; n++) {
+            stats.symbols[present[n]].freq++;
+        }
+    } else if (scaled_total > total_freq) {
+        // Take back one unit at a time from the symbol whose cost, about freqs / freq
+        // bits, is the lowest, the heap keeps that symbol on top.
+        auto higher_cost = [&stats, freqs](std::uint32_t lhs, std::uint32_t rhs) {
+            std::uint64_t lhs_cost = static_cast<std::uint64_t>(freqs[lhs]) * stats.symbols[rhs].freq;
+            std::uint64_t rhs_cost = static_cast<std::uint64_t>(freqs[rhs]) * stats.symbols[lhs].freq;
+            return (lhs_cost > rhs_cost);
+        };
+
+        std::size_t heap_size = 0;
+        for (std::size_t n = 0; n < num_symbols; n++) {
+            if (stats.symbols[present[n]].freq > 1)
+                present[heap_size++] = present[n];
+        }
+        std::make_heap(present, present + heap_size, higher_cost);
+
+        std::uint32_t excess = scaled_total - total_freq;
+        while (excess > 0) {
+            assert(heap_size > 0);
+            std::pop_heap(present, present + heap_size, higher_cost);
+            std::uint32_t symbol = present[heap_size - 1];
+            stats.symbols[symbol].freq--;
+            excess--;
+            if (stats.symbols[symbol].freq > 1)
+                std::push_heap(present, present + heap_size, higher_cost);
+            else
+                heap_size--;
+        }
+    }
+
+    stats.symbols[0].cumul = 0;
+    for (std::size_t i = 0; i < freq_size; i++) {
+        stats.symbols[i + 1].cumul = stats.symbols[i].cumul + stats.symbols[i].freq;
+    }
+    stats.symbols[freq_size].freq = 0;
+    stats.total_freq = total_freq;
+
+    assert(stats.symbols[freq_size].cumul == total_freq);
+    return true;
+}
+
+//
+// The model of the adaptive rANS, shared by rANSAdaptiveEncoder and rANSAdaptiveDecoder.
+//
+// Every symbol starts with a count of 1 (flat), each coded symbol adds kIncrement
+// to its count. The counts are rescaled to a new table at the start of each
+// block, the blocks grow from kMinInterval to kMaxInterval symbols, so the model
+// learns fast on short messages and the rescale cost stays low on long ones.
+//
+struct rANSAdaptiveModel {
+    static const std::uint32_t kInitCount   = 1;
+    static const std::uint32_t kIncrement   = 16;
+    static const std::size_t   kMinInterval = 16;
+    static const std::size_t   kMaxInterval = 1024;
+
+    // The largest content size whose counts can't overflow
+    static const std::uint32_t kMaxContentSize =
+        (0xFFFFFFFFu - kInitCount * kSymbolTotal) / kIncrement;
+
+    static std::size_t next_interval(std::size_t interval) {
+        return (interval < kMaxInterval) ? (interval * 2) : kMaxInterval;
+    }
+
+    static void init_counts(std::uint32_t * counts) {
+        for (std::size_t i = 0; i < kSymbolTotal; i++) {
+            counts[i] = kInitCount;
+        }
+    }
+
+    //
+    // Fast rescale, O(n) without division per symbol: every symbol gets 1 plus
+    // its share of (total_freq - kSymbolTotal) in 32.32 fixed point, the rounding
+    // remainder goes to the most frequent symbol.
+    //
+    static void rescale(SymbolStats & stats, const std::uint32_t * counts, std::uint32_t total_freq) {
+        assert(stats.symbols.size() > kSymbolTotal);
+        assert(total_freq > kSymbolTotal);
+
+        std::uint64_t sum_count = 0;
+        std::size_t max_symbol = 0;
+        for (std::size_t i = 0; i < kSymbolTotal; i++) {
+            sum_count += counts[i];
+            if (counts[i] > counts[max_symbol])
+                max_symbol = i;
+        }
+
+        // count <= sum_count, so (count * factor) can't overflow
+        std::uint64_t factor = (static_cast<std::uint64_t>(total_freq - kSymbolTotal) << 32) / sum_count;
+        std::uint32_t scaled_total = 0;
+        for (std::size_t i = 0; i < kSymbolTotal; i++) {
+            std::uint32_t freq = 1 + static_cast<std::uint32_t>((counts[i] * factor) >> 32);
+            stats.symbols[i].freq = freq;
+            scaled_total += freq;
+        }
+        stats.symbols[max_symbol].freq += (total_freq - scaled_total);
+
+        stats.symbols[0].cumul = 0;
+        for (std::size_t i = 0; i < kSymbolTotal; i++) {
+            stats.symbols[i + 1].cumul = stats.symbols[i].cumul + stats.symbols[i].freq;
+        }
+        stats.symbols[kSymbolTotal].freq = 0;
+        stats.min_symbol = 0;
+        stats.max_symbol = static_cast<std::uint8_t>(kMaxSymbol);
+        stats.total_freq = total_freq;
+    }
+};
+
 } // namespace ziplab
 
 #endif // ZIPLAB_RANS_RANS_H
@@ -0,0 +1,177 @@
+#ifndef ZIPLAB_RANS_RANSADAPTIVEDECODER_HPP
+#define ZIPLAB_RANS_RANSADAPTIVEDECODER_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/rans/rANS.h"
+
+#include "ziplab/stream/MemoryBuffer.h"
+#include "ziplab/stream/InputStream.h"
+
+namespace ziplab {
+
+//
+// Decoder of the adaptive rANS, see rANSAdaptiveEncoder for the format.
+// The template arguments must be the same as the encoder that produced the data.
+//
+template <typename CharT, std::size_t NumStates = 2, std::size_t ScaleBits = 12,
+          typename StateT = std::uint32_t, typename WordT = std::uint8_t>
+class rANSAdaptiveDecoder {
+public:
+    using char_type = CharT;
+    using size_type = std::size_t;
+    using ssize_type = std::intptr_t;
+
+    using traits_type = rANSTraits<ScaleBits, StateT, WordT>;
+    using model_type  = rANSAdaptiveModel;
+    using state_type  = StateT;
+    using word_type   = WordT;
+
+    static const size_type     kScaleBits  = traits_type::kScaleBits;
+    static const std::uint32_t kTotalFreq  = traits_type::kTotalFreq;
+    static const std::uint32_t kScaleMask  = traits_type::kScaleMask;
+    static const size_type     kWordBits   = traits_type::kWordBits;
+    static const state_type    kLowerBound = traits_type::kLowerBound;
+    static const state_type    kInitState  = kLowerBound;
+
+    static const size_type kNumStates = NumStates;
+
+    static_assert((NumStates == 1 || NumStates == 2 || NumStates == 4 || NumStates == 8),
+                  "rANSAdaptiveDecoder: NumStates must be 1, 2, 4 or 8");
+
+    using Symbol = std::uint8_t;
+
+private:
+    // The symbol of each slot in [0, kTotalFreq)
+    std::vector<Symbol> cum2sym_;
+
+public:
+    rANSAdaptiveDecoder() : cum2sym_(kTotalFreq) {
+        //
+    }
+
+    virtual ~rANSAdaptiveDecoder() {
+        //
+    }
+
+private:
+    void init_symbol_stats(SymbolStats & stats, const std::uint32_t * counts) {
+        model_type::rescale(stats, counts, kTotalFreq);
+
+        // Build the slot to symbol table
+        for (size_type symbol = 0; symbol < kSymbolTotal; symbol++) {
+            std::uint32_t cumul = stats.symbols[symbol].cumul;
+            std::uint32_t cumul_end = cumul + stats.symbols[symbol].freq;
+            for (std::uint32_t slot = cumul; slot < cumul_end; slot++) {
+                cum2sym_[slot] = static_cast<Symbol>(symbol);
+            }
+        }
+    }
+
+public:
+    //
+    // The format has no compressed size, so running out of the input words
+    // is reported by underrun instead, the data has been truncated.
+    //
+    ZIPLAB_FORCED_INLINE
+    state_type decode(const SymbolStats & stats, state_type state, Symbol & symbol,
+                      InputStream & input_is, bool & underrun) {
+        std::uint32_t slot = static_cast<std::uint32_t>(state & kScaleMask);
+        symbol = cum2sym_[slot];
+
+        const SymbolStat & stat = stats.symbols[symbol];
+        state_type nextState = (state >> kScaleBits) * stat.freq + (slot - stat.cumul);
+
+        // Normalize, the words are read straight from the input
+        while (nextState < kLowerBound) {
+            word_type word;
+            if (input_is.readValue(word)) {
+                nextState = (nextState << kWordBits) | word;
+            } else {
+                underrun = true;
+                break;
+            }
+        }
+
+        return nextState;
+    }
+
+    int decompress(MemoryBuffer & compressed_data, MemoryBuffer & decompressed_data) {
+        int err_code = 0;
+        InputStream input_is(compressed_data);
+
+        size_type data_size = compressed_data.size();
+        if (ziplab_likely(data_size != 0)) {
+            // Read the content size, 7 bits per byte, low bits first
+            std::uint32_t content_size = 0;
+            std::uint8_t byte;
+            std::uint32_t shift = 0;
+            do {
+                if (!input_is.readUInt8(byte) || (shift > 28))
+                    return -1;
+                content_size |= static_cast<std::uint32_t>(byte & 0x7Fu) << shift;
+                shift += 7;
+            } while ((byte & 0x80u) != 0);
+
+            if (content_size > model_type::kMaxContentSize)
+                return -1;
+
+            state_type states[NumStates];
+            for (size_type n = 0; n < NumStates; n++) {
+                if (!input_is.readValue(states[n]))
+                    return -1;
+            }
+
+            decompressed_data.grow(content_size);
+            Symbol * output = reinterpret_cast<Symbol *>(decompressed_data.current());
+
+            std::uint32_t counts[kSymbolTotal];
+            model_type::init_counts(counts);
+
+            // Update the model in lock-step with the encoder,
+            // the symbol i uses the state (i % NumStates)
+            SymbolStats stats(kSymbolTotal);
+            size_type interval = model_type::kMinInterval;
+            size_type block_start = 0;
+            bool underrun = false;
+            while (block_start < content_size) {
+                init_symbol_stats(stats, counts);
+
+                size_type block_end = (std::min)(block_start + interval, static_cast<size_type>(content_size));
+                for (size_type i = block_start; i < block_end; i++) {
+                    state_type & state = states[i % NumStates];
+                    Symbol symbol;
+                    state = decode(stats, state, symbol, input_is, underrun);
+                    output[i] = symbol;
+                    counts[symbol] += model_type::kIncrement;
+                }
+                if (ziplab_unlikely(underrun))
+                    return -1;
+
+                block_start = block_end;
+                interval = model_type::next_interval(interval);
+            }
+
+            // All the input must be consumed, and the states are back to the initial state
+            if (input_is.npos() != data_size)
+                return -1;
+            for (size_type n = 0; n < NumStates; n++) {
+                if (states[n] != kInitState)
+                    return -1;
+            }
+
+            decompressed_data.forward(content_size);
+        }
+
+        return err_code;
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_RANS_RANSADAPTIVEDECODER_HPP
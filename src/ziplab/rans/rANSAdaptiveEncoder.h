@@ -0,0 +1,174 @@
+#ifndef ZIPLAB_RANS_RANSADAPTIVEENCODER_HPP
+#define ZIPLAB_RANS_RANSADAPTIVEENCODER_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/rans/rANS.h"
+
+#include "ziplab/stream/MemoryBuffer.h"
+#include "ziplab/stream/OutputStream.h"
+
+namespace ziplab {
+
+//
+// Adaptive rANS, no frequency table is transmitted: the encoder and the decoder
+// update the same model (see rANSAdaptiveModel) in lock-step, it's intended
+// for the small messages, where a static table would dominate the output.
+//
+// rANS encodes backward, but the model evolves forward. The encoder first counts
+// the whole input, then walks the blocks from the last one, removing the counts
+// of each block to get the table which the decoder will use for it.
+//
+// Format:
+//   [content size: varint][states: sizeof(StateT) * NumStates][words: sizeof(WordT) * N]
+//
+template <typename CharT, std::size_t NumStates = 2, std::size_t ScaleBits = 12,
+          typename StateT = std::uint32_t, typename WordT = std::uint8_t>
+class rANSAdaptiveEncoder {
+public:
+    using char_type = CharT;
+    using size_type = std::size_t;
+    using ssize_type = std::intptr_t;
+
+    using traits_type = rANSTraits<ScaleBits, StateT, WordT>;
+    using model_type  = rANSAdaptiveModel;
+    using state_type  = StateT;
+    using word_type   = WordT;
+
+    using reciprocal_type = rANSReciprocal<StateT>;
+
+    static const size_type     kScaleBits  = traits_type::kScaleBits;
+    static const std::uint32_t kTotalFreq  = traits_type::kTotalFreq;
+    static const size_type     kWordBits   = traits_type::kWordBits;
+    static const state_type    kLowerBound = traits_type::kLowerBound;
+    static const state_type    kInitState  = kLowerBound;
+
+    static const size_type kNumStates = NumStates;
+
+    static_assert((NumStates == 1 || NumStates == 2 || NumStates == 4 || NumStates == 8),
+                  "rANSAdaptiveEncoder: NumStates must be 1, 2, 4 or 8");
+
+    using Symbol = std::uint8_t;
+
+public:
+    rANSAdaptiveEncoder() {
+        //
+    }
+
+    virtual ~rANSAdaptiveEncoder() {
+        //
+    }
+
+private:
+    void init_symbol_stats(SymbolStats & stats, const std::uint32_t * counts) {
+        model_type::rescale(stats, counts, kTotalFreq);
+
+        // Precompute the reciprocal of the frequencies, all the symbols are present
+        for (size_type symbol = 0; symbol < kSymbolTotal; symbol++) {
+            reciprocal_type::init(stats.symbols[symbol], static_cast<std::uint32_t>(kScaleBits));
+        }
+    }
+
+public:
+    ZIPLAB_FORCED_INLINE
+    state_type encode(const SymbolStat & stat, state_type state,
+                      std::vector<word_type> & words) {
+        std::uint32_t freq = stat.freq;
+
+        // Normalize
+        state_type max_state = ((kLowerBound >> kScaleBits) << kWordBits) * freq;
+        while (state >= max_state) {
+            words.push_back(static_cast<word_type>(state));
+            state >>= kWordBits;
+        }
+
+        // nextState = (state / freq) * kTotalFreq + (state % freq) + cumul
+        state_type quotient = reciprocal_type::quotient(state, stat);
+        return (state + stat.bias + quotient * (kTotalFreq - freq));
+    }
+
+    int compress(const std::string & input_data, MemoryBuffer & compressed_data) {
+        int err_code = 0;
+        OutputStream output_os(compressed_data);
+
+        size_type data_size = input_data.size();
+        if (ziplab_likely(data_size != 0)) {
+            if (data_size > model_type::kMaxContentSize)
+                return -1;
+
+            const Symbol * data = reinterpret_cast<const Symbol *>(input_data.data());
+
+            // The counts after the last symbol, and the start of each block
+            std::uint32_t counts[kSymbolTotal];
+            model_type::init_counts(counts);
+            for (size_type i = 0; i < data_size; i++) {
+                counts[data[i]] += model_type::kIncrement;
+            }
+
+            std::vector<size_type> block_starts;
+            size_type interval = model_type::kMinInterval;
+            size_type start = 0;
+            while (start < data_size) {
+                block_starts.push_back(start);
+                start += interval;
+                interval = model_type::next_interval(interval);
+            }
+
+            // Write the content size, 7 bits per byte, low bits first
+            std::uint32_t content_size = static_cast<std::uint32_t>(data_size);
+            while (content_size >= 0x80u) {
+                output_os.writeUInt8(static_cast<std::uint8_t>(content_size | 0x80u));
+                content_size >>= 7;
+            }
+            output_os.writeUInt8(static_cast<std::uint8_t>(content_size));
+
+            std::vector<word_type> words;
+            words.reserve(data_size / sizeof(word_type) + 1);
+
+            // Encode the blocks backward, the symbol i uses the state (i % NumStates)
+            SymbolStats stats(kSymbolTotal);
+            state_type states[NumStates];
+            for (size_type n = 0; n < NumStates; n++) {
+                states[n] = kInitState;
+            }
+
+            size_type block_end = data_size;
+            for (size_type block = block_starts.size(); block > 0; block--) {
+                size_type block_start = block_starts[block - 1];
+                for (size_type i = block_start; i < block_end; i++) {
+                    counts[data[i]] -= model_type::kIncrement;
+                }
+                init_symbol_stats(stats, counts);
+
+                for (size_type i = block_end; i > block_start; i--) {
+                    Symbol symbol = data[i - 1];
+                    state_type & state = states[(i - 1) % NumStates];
+                    state = encode(stats.symbols[symbol], state, words);
+                }
+                block_end = block_start;
+            }
+
+            for (size_type n = 0; n < NumStates; n++) {
+                output_os.writeValue(states[n]);
+            }
+
+            // Write the words in the order of decoding
+            output_os.reserve(output_os.size() + words.size() * sizeof(word_type));
+            for (auto iter = words.rbegin(); iter != words.rend(); ++iter) {
+                output_os.writeValue(*iter);
+            }
+        }
+
+        return err_code;
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_RANS_RANSADAPTIVEENCODER_HPP
@@ -22,91 +22,121 @@
 
 namespace ziplab {
 
-template <typename CharT>
-class rANSDecoder64 {
+//
+// The template arguments must be the same as the rANSEncoder that produced the data.
+//
+template <typename CharT, std::size_t NumStates = 1, std::size_t ScaleBits = 16,
+          typename StateT = std::uint64_t, typename WordT = std::uint32_t>
+class rANSDecoder {
 public:
     using char_type = CharT;
     using size_type = std::size_t;
     using ssize_type = std::intptr_t;
     using offset_type = std::uint16_t;
 
-    static const size_type kTotalFreq = 65536;
-    //static const size_type kInitState = 0x7FFFFFFFu;
-    static const size_type kInitState = 0x80000000u;
-    //static const size_type kMaxState  = 0xFFFFFFFFFFFFFFFFull;
-    static const size_type kMaxState  = 0x8000000000000000ull;
+    using traits_type = rANSTraits<ScaleBits, StateT, WordT>;
+    using state_type  = StateT;
+    using word_type   = WordT;
+
+    static const size_type     kScaleBits  = traits_type::kScaleBits;
+    static const std::uint32_t kTotalFreq  = traits_type::kTotalFreq;
+    static const std::uint32_t kScaleMask  = traits_type::kScaleMask;
+    static const size_type     kWordBits   = traits_type::kWordBits;
+    static const state_type    kLowerBound = traits_type::kLowerBound;
+    static const state_type    kInitState  = kLowerBound;
+
+    static const size_type kNumStates = NumStates;
+
+    static_assert((NumStates == 1 || NumStates == 2 || NumStates == 4 || NumStates == 8),
+                  "rANSDecoder: NumStates must be 1, 2, 4 or 8");
 
     using Symbol = std::uint8_t;
 
+private:
+    // The symbol of each slot in [0, kTotalFreq)
+    std::vector<Symbol> cum2sym_;
+
 public:
-    rANSDecoder64() {
+    rANSDecoder() : cum2sym_(kTotalFreq) {
         //
     }
 
-    virtual ~rANSDecoder64() {
+    virtual ~rANSDecoder() {
         //
     }
 
 private:
-    void read_symbol_stats(SymbolStats & stats, InputStream & input_is) {
+    bool read_symbol_stats(SymbolStats & stats, InputStream & input_is) {
         // Read symbol range: [min_symbol, max_symbol]
-        stats.min_symbol = input_is.readUInt8();
-        stats.max_symbol = input_is.readUInt8();
+        if (!input_is.readUInt8(stats.min_symbol) || !input_is.readUInt8(stats.max_symbol))
+            return false;
+        if (stats.min_symbol > stats.max_symbol)
+            return false;
 
-        // Write symbol sacled frequencies
+        // Read symbol scaled frequencies, 7 bits per byte, low bits first
         for (size_type symbol = stats.min_symbol; symbol <= (size_type)stats.max_symbol; symbol++) {
-            std::uint16_t freq = input_is.readUInt16();
-            stats.symbols[symbol].freq = static_cast<std::uint32_t>(freq);
+            std::uint32_t freq = 0;
+            std::uint8_t byte;
+            std::uint32_t shift = 0;
+            do {
+                if (!input_is.readUInt8(byte) || (shift > 14))
+                    return false;
+                freq |= static_cast<std::uint32_t>(byte & 0x7Fu) << shift;
+                shift += 7;
+            } while ((byte & 0x80u) != 0);
+
+            if (freq > kTotalFreq)
+                return false;
+            stats.symbols[symbol].freq = freq;
         }
+        return true;
     }
 
-    void init_symbol_stats(SymbolStats & stats) {
+    bool init_symbol_stats(SymbolStats & stats) {
         // Calc symbol cumulative frequency
         stats.symbols[0].cumul = 0;
-        for (std::size_t i = 0; i < kSymbolTotal - 1; i++) {
+        for (std::size_t i = 0; i < kSymbolTotal; i++) {
             stats.symbols[i + 1].cumul = stats.symbols[i].cumul + stats.symbols[i].freq;
         }
-        size_type scale_total_freq = stats.symbols[kMaxSymbol].cumul;
+        size_type scale_total_freq = stats.symbols[kSymbolTotal].cumul;
         stats.total_freq = static_cast<std::uint32_t>(scale_total_freq);
-        assert(scale_total_freq == kTotalFreq);
-    }
+        if (scale_total_freq != kTotalFreq)
+            return false;
 
-    void read_state_data(InputStream & input_is, std::vector<std::uint32_t> & compressed_states) {
-        compressed_states.clear();
-        while (!input_is.is_overflow()) {
-            std::uint32_t state32 = input_is.readUInt32();
-            if (state32 == 0)
-                break;
-            compressed_states.push_back(state32);
-        };
+        // Build the slot to symbol table
+        for (size_type symbol = stats.min_symbol; symbol <= (size_type)stats.max_symbol; symbol++) {
+            std::uint32_t cumul = stats.symbols[symbol].cumul;
+            std::uint32_t cumul_end = cumul + stats.symbols[symbol].freq;
+            for (std::uint32_t slot = cumul; slot < cumul_end; slot++) {
+                cum2sym_[slot] = static_cast<Symbol>(symbol);
+            }
+        }
+        return true;
     }
 
 public:
-    std::uint64_t decode(const SymbolStats & stats, std::uint64_t state, std::size_t & symbol,
-                         std::vector<std::uint32_t> states, ssize_type & pos,
-                         OutputStream & output_os) {
-        std::uint32_t slot = state % kTotalFreq;
-
-        symbol = 0;
-        while (slot >= stats.symbols[symbol + 1].cumul) {
-            ++symbol;
-            if (symbol >= kSymbolTotal) {
-                return 0;
-            }
-        }
+    //
+    // Running out of the input words is reported by underrun,
+    // the data has been truncated.
+    //
+    state_type decode(const SymbolStats & stats, state_type state, Symbol & symbol,
+                      InputStream & input_is, bool & underrun) {
+        std::uint32_t slot = static_cast<std::uint32_t>(state & kScaleMask);
+        symbol = cum2sym_[slot];
 
         std::uint32_t freq = stats.symbols[symbol].freq;
         std::uint32_t cumul = stats.symbols[symbol].cumul;
 
-        std::uint64_t remainder = static_cast<std::uint64_t>(slot - cumul);
-        std::uint64_t nextState = state / kTotalFreq * freq + remainder;
+        state_type remainder = static_cast<state_type>(slot - cumul);
+        state_type nextState = (state >> kScaleBits) * freq + remainder;
 
-        // Normalize
-        while (nextState <= kInitState) {
-            if (pos >= 0) {
-                nextState = (nextState << 32) | (states[pos] & 0xFFFFFFFFul);
-                --pos;
+        // Normalize, the words are read straight from the input
+        while (nextState < kLowerBound) {
+            word_type word;
+            if (input_is.readValue(word)) {
+                nextState = (nextState << kWordBits) | word;
             } else {
+                underrun = true;
                 break;
             }
         }
@@ -122,41 +152,44 @@ public:
         size_type data_size = compressed_data.size();
         if (ziplab_likely(data_size != 0)) {
             SymbolStats stats(kSymbolTotal);
-            read_symbol_stats(stats, input_is);
-            init_symbol_stats(stats);
+            if (!read_symbol_stats(stats, input_is) || !init_symbol_stats(stats))
+                return -1;
 
-            size_type content_size = static_cast<size_type>(input_is.readUInt32());
-            size_type compressed_size = static_cast<size_type>(input_is.readUInt32());
+            std::uint32_t content_size, compressed_size;
+            if (!input_is.readUInt32(content_size) || !input_is.readUInt32(compressed_size))
+                return -1;
 
-            std::vector<std::uint32_t> data_states;
-            read_state_data(input_is, data_states);
+            if ((compressed_size < NumStates * sizeof(state_type)) ||
+                (compressed_size > (data_size - input_is.npos())))
+                return -1;
 
-            std::uint64_t state = 0;
+            size_type compressed_end = input_is.npos() + compressed_size;
 
-            // Read init state
-            ssize_type count = 0;
-            for (auto iter = data_states.rbegin(); iter != data_states.rend(); ++iter) {
-                state = (state << 32) | (*iter);
-                count++;
-                if (count >= 2)
-                    break;
+            state_type states[NumStates];
+            for (size_type n = 0; n < NumStates; n++) {
+                if (!input_is.readValue(states[n]))
+                    return -1;
             }
 
-            for (; count > 0; count--) {
-                data_states.pop_back();
-            }
+            decompressed_data.reserve(decompressed_data.size() + content_size);
 
-            ssize_type pos = data_states.size() - 1;
-            while (content_size > 0) {                
-                std::size_t symbol;
-                state = decode(stats, state, symbol, data_states, pos, output_os);
-                if (symbol < kSymbolTotal) {
-                    output_os.writeUInt8(static_cast<Symbol>(symbol));
-                    assert(content_size > 0);
-                    content_size--;
-                } else {
-                    break;
-                }
+            // The symbol i uses the state (i % NumStates)
+            bool underrun = false;
+            for (size_type i = 0; i < content_size; i++) {
+                state_type & state = states[i % NumStates];
+                Symbol symbol;
+                state = decode(stats, state, symbol, input_is, underrun);
+                output_os.writeUInt8(symbol);
+            }
+            if (ziplab_unlikely(underrun))
+                return -1;
+
+            // All the compressed data must be consumed, and the states are back to the initial state
+            if (input_is.npos() != compressed_end)
+                return -1;
+            for (size_type n = 0; n < NumStates; n++) {
+                if (states[n] != kInitState)
+                    return -1;
             }
         }
 
@@ -164,6 +197,14 @@ public:
     }
 };
 
+// 64-bit states with 32-bit renormalization.
+template <typename CharT, std::size_t NumStates = 1, std::size_t ScaleBits = 16>
+using rANSDecoder64 = rANSDecoder<CharT, NumStates, ScaleBits, std::uint64_t, std::uint32_t>;
+
+// 32-bit states with byte-wise renormalization.
+template <typename CharT, std::size_t NumStates = 1, std::size_t ScaleBits = 12>
+using rANSDecoder32 = rANSDecoder<CharT, NumStates, ScaleBits, std::uint32_t, std::uint8_t>;
+
 } // namespace ziplab
 
 #endif // ZIPLAB_RANS_RANSDECODER_HPP
@@ -6,6 +6,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>      // For std::memcpy()
 #include <bitset>
 #include <vector>
 #include <string>
@@ -15,139 +16,100 @@
 #include <stdexcept>
 
 #include "ziplab/rans/rANS.h"
+#include "ziplab/entropy/Histogram.h"
 
 #include "ziplab/stream/MemoryBuffer.h"
 #include "ziplab/stream/InputStream.h"
 #include "ziplab/stream/OutputStream.h"
 
-#include <windows.h>
+//
+// Optional compile-time trace hook, it's called for each encoded symbol.
+// Define ZIPLAB_RANS_TRACE_SYMBOL(symbol, state) before including this file
+// to trace the encoder, by default it compiles to nothing.
+//
+#ifndef ZIPLAB_RANS_TRACE_SYMBOL
+#define ZIPLAB_RANS_TRACE_SYMBOL(symbol, state)     ((void)0)
+#endif
 
 namespace ziplab {
 
-template <typename CharT>
-class rANSEncoder64 {
+//
+// NumStates is the number of interleaved rANS states (1, 2, 4 or 8).
+// Consecutive symbols are assigned round-robin to the states, which share
+// one output stream, so the encode and decode of the states can overlap.
+//
+// ScaleBits, StateT and WordT are the probability scale, the state width
+// and the renormalization unit, see rANSTraits.
+//
+// Format:
+//   [min_symbol: 1][max_symbol: 1][freq: varint * (max - min + 1)]
+//   [content size: 4][compressed size: 4]
+//   [states: sizeof(StateT) * NumStates][words: sizeof(WordT) * N]
+//
+// The compressed size is the size of the states and the words in bytes.
+// The encoder runs backward, so it reverses the words it emitted, then the
+// decoder reads the states and the words forward, straight from the input.
+//
+template <typename CharT, std::size_t NumStates = 1, std::size_t ScaleBits = 16,
+          typename StateT = std::uint64_t, typename WordT = std::uint32_t>
+class rANSEncoder {
 public:
     using char_type = CharT;
     using size_type = std::size_t;
     using ssize_type = std::intptr_t;
     using offset_type = std::uint16_t;
 
-    static const size_type kTotalFreq = 65536;
-    //static const size_type kInitState = 0x7FFFFFFFu;
-    static const size_type kInitState = 0x80000000u;
-    //static const size_type kMaxState  = 0xFFFFFFFFFFFFFFFFull;
-    static const size_type kMaxState  = 0x8000000000000000ull;
+    using traits_type = rANSTraits<ScaleBits, StateT, WordT>;
+    using state_type  = StateT;
+    using word_type   = WordT;
+
+    using reciprocal_type = rANSReciprocal<StateT>;
+
+    static const size_type     kScaleBits  = traits_type::kScaleBits;
+    static const std::uint32_t kTotalFreq  = traits_type::kTotalFreq;
+    static const size_type     kWordBits   = traits_type::kWordBits;
+    static const state_type    kLowerBound = traits_type::kLowerBound;
+    static const state_type    kInitState  = kLowerBound;
+
+    static const size_type kNumStates = NumStates;
+
+    static_assert((NumStates == 1 || NumStates == 2 || NumStates == 4 || NumStates == 8),
+                  "rANSEncoder: NumStates must be 1, 2, 4 or 8");
 
     using Symbol = std::uint8_t;
 
 public:
-    rANSEncoder64() {
+    rANSEncoder() {
         //
     }
 
-    virtual ~rANSEncoder64() {
+    virtual ~rANSEncoder() {
         //
     }
 
 private:
-    void count_freq(const std::string & input_data, std::uint32_t * freqs,
-                    std::uint32_t * cumuls, std::size_t freq_size) {
-        for (std::size_t i = 0; i < freq_size; i++) {
-            freqs[i] = 0;
-        }
+    void count_freq(const std::string & input_data, std::uint32_t * freqs, std::size_t freq_size) {
+        assert(freq_size == kHistogramSymbols);
+        ZIPLAB_UNUSED(freq_size);
 
         // Count symbol frequency
         // 13, 10, 2, 1
-        for (const std::uint8_t ch : input_data) {
-            freqs[ch]++;
-        }
-
-        // Calc symbol cumulative frequency
-        // 13, 23, 25, 26
-        cumuls[0] = 0;
-        for (std::size_t i = 0; i < (freq_size - 1); i++) {
-            cumuls[i + 1] = cumuls[i] + freqs[i];
-        }
+        count_histogram(input_data.data(), input_data.size(), freqs);
     }
 
-    void init_symbol_stats(SymbolStats & stats, std::uint32_t * freqs,
-                           std::uint32_t * cumuls, std::size_t freq_size) {
-        // Get min symbol: 'A'
-        for (std::size_t i = 0; i < freq_size; i++) {
-            if (freqs[i] > 0) {
-                stats.min_symbol = static_cast<std::uint8_t>(i);
-                break;
-            }
-        }
-
-        // Get max symbol: 'D'
-        for (std::size_t i = freq_size - 1; i >= 0; i--) {
-            if (freqs[i] > 0) {
-                stats.max_symbol = static_cast<std::uint8_t>(i);
-                break;
-            }
-        }
-
-        // Total frequency
-        // 26
-        stats.total_freq = cumuls[kMaxSymbol];
-        if (stats.total_freq == 0) return;
-
-        // Rescale the frequency
-        // 32768, 25206, 5041, 2520
-        for (std::size_t i = 0; i < freq_size; i++) {
-            stats.symbols[i].freq = freqs[i] * kTotalFreq / stats.total_freq;
-        }
-        // For stats.symbols[kSymbolTotal]
-        stats.symbols[freq_size].freq = 0;
-
-        // Calc the scaled cumulative frequency
-        // 13, 23, 25, 26
-        stats.symbols[0].cumul = 0;
-        for (std::size_t i = 0; i < (freq_size - 1); i++) {
-            stats.symbols[i + 1].cumul = stats.symbols[i].cumul + stats.symbols[i].freq;
-        }
-        // For stats.symbols[kSymbolTotal]
-        stats.symbols[freq_size].cumul = stats.symbols[freq_size - 1].cumul + stats.symbols[freq_size - 1].freq;
-
-        size_type scale_total_freq = stats.symbols[kMaxSymbol].cumul;
-
-        // Get freq errors
-        double freq_errs[kSymbolTotal];
-        for (std::size_t i = 0; i < freq_size; i++) {
-            freq_errs[i] = (double)freqs[i] * kTotalFreq / stats.total_freq - stats.symbols[i].freq;
-        }
+    bool init_symbol_stats(SymbolStats & stats, const std::uint32_t * freqs, std::size_t freq_size) {
+        // Rescale the frequency to kTotalFreq, the present symbols keep a nonzero frequency
+        // 32768, 25206, 5041, 2521
+        if (!normalize_symbol_stats(stats, freqs, freq_size, kTotalFreq))
+            return false;
 
-        // Adjust the scaled frequency
-        for (std::size_t n = scale_total_freq; n < kTotalFreq; n++) {
-            double max_errs = 0.0;
-            std::size_t adjust_symbol = static_cast<std::size_t>(-1);
-            for (std::size_t i = 0; i < freq_size; i++) {
-                if (freq_errs[i] > max_errs) {
-                    max_errs = freq_errs[i];
-                    adjust_symbol = i;
-                }
-            }
-            if (adjust_symbol != static_cast<std::size_t>(-1)) {
-                stats.symbols[adjust_symbol].freq++;
-                freq_errs[adjust_symbol] = (double)freqs[adjust_symbol] * kTotalFreq / stats.total_freq
-                                            - stats.symbols[adjust_symbol].freq;
-            } else {
-                break;
+        // Precompute the reciprocal of the frequencies
+        for (size_type symbol = stats.min_symbol; symbol <= stats.max_symbol; symbol++) {
+            if (stats.symbols[symbol].freq != 0) {
+                reciprocal_type::init(stats.symbols[symbol], static_cast<std::uint32_t>(kScaleBits));
             }
         }
-
-        // Recalc symbol cumulative frequency
-        // 32768, 25206, 5041, 2521
-        stats.symbols[0].cumul = 0;
-        for (std::size_t i = 0; i < (freq_size - 1); i++) {
-            stats.symbols[i + 1].cumul = stats.symbols[i].cumul + stats.symbols[i].freq;
-        }
-        // For stats.symbols[kSymbolTotal]
-        stats.symbols[freq_size].cumul = stats.symbols[freq_size - 1].cumul + stats.symbols[freq_size - 1].freq;
-
-        scale_total_freq = stats.symbols[kMaxSymbol].cumul;
-        assert(scale_total_freq == kTotalFreq);
+        return true;
     }
 
     void write_symbol_stats(const SymbolStats & stats, OutputStream & output_os) {
@@ -155,57 +117,47 @@ private:
         output_os.writeUInt8(stats.min_symbol);
         output_os.writeUInt8(stats.max_symbol);
 
-        // Write symbol sacled frequencies
-        for (Symbol symbol = stats.min_symbol; symbol <= stats.max_symbol; symbol++) {
-            std::uint16_t freq = static_cast<std::uint16_t>(stats.symbols[symbol].freq);
-            output_os.writeUInt16(freq);
+        // Write symbol scaled frequencies, 7 bits per byte, low bits first
+        for (size_type symbol = stats.min_symbol; symbol <= stats.max_symbol; symbol++) {
+            std::uint32_t freq = stats.symbols[symbol].freq;
+            while (freq >= 0x80u) {
+                output_os.writeUInt8(static_cast<std::uint8_t>(freq | 0x80u));
+                freq >>= 7;
+            }
+            output_os.writeUInt8(static_cast<std::uint8_t>(freq));
         }
     }
 
 public:
-    /*
-        // Process four states at once using the AVX2 instruction set (pseudocode)
-        __m256i states = _mm256_load_si256(state_ptr);
-        __m256i mask = _mm256_cmpgt_epi32(states, threshold_vec);
-        while (_mm256_movemask_epi8(mask)) {
-
-            // Batch extract and write low byte data
-            __m256i bytes = _mm256_and_si256(states, _mm256_set1_epi32(0xFF));
-            _mm256_storeu_si256(output_ptr, bytes);
-
-            // Parallel right shift by 8 bits
-            states = _mm256_srli_epi32(states, 8);
-            mask = _mm256_cmpgt_epi32(states, threshold_vec);
-        }
-    //*/
-    std::uint64_t encode(const SymbolStats & stats, std::uint64_t state, Symbol symbol,
-                         OutputStream & output_os) {
-        std::uint32_t freq = stats.symbols[symbol].freq;
-        std::uint32_t cumul = stats.symbols[symbol].cumul;
+    state_type encode(const SymbolStats & stats, state_type state, Symbol symbol,
+                      std::vector<word_type> & words) {
+        const SymbolStat & stat = stats.symbols[symbol];
+        std::uint32_t freq = stat.freq;
 
         // Normalize
-        while (state >= (kMaxState / (kTotalFreq + 1)) * freq) {
-            std::uint32_t low32 = static_cast<std::uint32_t>(state & 0x00000000FFFFFFFFull);
-            output_os.writeUInt32(low32);
-            state >>= 32;
+        state_type max_state = ((kLowerBound >> kScaleBits) << kWordBits) * freq;
+        while (state >= max_state) {
+            words.push_back(static_cast<word_type>(state));
+            state >>= kWordBits;
         }
 
-        std::uint64_t quotient = state / freq;
-        std::uint64_t remainder = state % freq;
-        std::uint64_t nextState = quotient * kTotalFreq + cumul + remainder;
+        // nextState = (state / freq) * kTotalFreq + (state % freq) + cumul
+        state_type quotient = reciprocal_type::quotient(state, stat);
+        state_type nextState = state + stat.bias + quotient * (kTotalFreq - freq);
         return nextState;
     }
 
-    void finish(std::uint64_t state, OutputStream & output_os) {
-        if (state != 0) {
-            std::uint32_t low32 = static_cast<std::uint32_t>(state & 0x00000000FFFFFFFFull);
-            output_os.writeUInt32(low32);
-            if (state > 0x00000000FFFFFFFFull) {
-                std::uint32_t high32 = static_cast<std::uint32_t>(state >> 32);
-                output_os.writeUInt32(high32);
-            }
+    void finish(const state_type * states, const std::vector<word_type> & words,
+                OutputStream & output_os) {
+        for (size_type n = 0; n < NumStates; n++) {
+            output_os.writeValue(states[n]);
+        }
+
+        // Write the words in the order of decoding
+        output_os.reserve(output_os.size() + words.size() * sizeof(word_type));
+        for (auto iter = words.rbegin(); iter != words.rend(); ++iter) {
+            output_os.writeValue(*iter);
         }
-        output_os.writeUInt32(0);
     }
 
     int compress(const std::string & input_data, MemoryBuffer & compressed_data) {
@@ -215,36 +167,56 @@ public:
         size_type data_size = input_data.size();
         if (ziplab_likely(data_size != 0)) {
             std::uint32_t freqs[kSymbolTotal];
-            std::uint32_t cumuls[kSymbolTotal];
-            count_freq(input_data, freqs, cumuls, kSymbolTotal);
+            count_freq(input_data, freqs, kSymbolTotal);
 
             SymbolStats stats(kSymbolTotal);
-            init_symbol_stats(stats, freqs, cumuls, kSymbolTotal);
+            if (!init_symbol_stats(stats, freqs, kSymbolTotal))
+                return -1;
 
             // Output symbol stats
             write_symbol_stats(stats, output_os);
 
             // Write the content size
             output_os.writeUInt32(static_cast<std::uint32_t>(data_size));
-            // Write the compressed data size
+            // Write the compressed data size, fill it after encoding
+            size_type compressed_size_pos = compressed_data.size();
             output_os.writeUInt32(0);
 
-            // Start encode
-            std::uint64_t state = kInitState;
-            for (auto iter = input_data.rbegin(); iter != input_data.rend(); ++iter) {
-                Symbol symbol = static_cast<Symbol>(*iter);
-                std::string str(1, symbol);
-                ::OutputDebugString(str.c_str());
-                state = encode(stats, state, symbol, output_os);
+            size_type compressed_start = compressed_data.size();
+
+            std::vector<word_type> words;
+            words.reserve(data_size / sizeof(word_type) + 1);
+
+            // Start encode, in reverse order, the symbol i uses the state (i % NumStates)
+            state_type states[NumStates];
+            for (size_type n = 0; n < NumStates; n++) {
+                states[n] = kInitState;
             }
+            for (size_type i = data_size; i > 0; i--) {
+                Symbol symbol = static_cast<Symbol>(input_data[i - 1]);
+                state_type & state = states[(i - 1) % NumStates];
+                ZIPLAB_RANS_TRACE_SYMBOL(symbol, state);
+                state = encode(stats, state, symbol, words);
+            }
+
+            finish(states, words, output_os);
 
-            finish(state, output_os);
+            std::uint32_t compressed_size = static_cast<std::uint32_t>(compressed_data.size() - compressed_start);
+            std::memcpy(compressed_data.data() + compressed_size_pos, &compressed_size, sizeof(compressed_size));
         }
 
         return err_code;
     }
 };
 
+// 64-bit states with 32-bit renormalization.
+template <typename CharT, std::size_t NumStates = 1, std::size_t ScaleBits = 16>
+using rANSEncoder64 = rANSEncoder<CharT, NumStates, ScaleBits, std::uint64_t, std::uint32_t>;
+
+// 32-bit states with byte-wise renormalization.
+template <typename CharT, std::size_t NumStates = 1, std::size_t ScaleBits = 12>
+using rANSEncoder32 = rANSEncoder<CharT, NumStates, ScaleBits, std::uint32_t, std::uint8_t>;
+
 } // namespace ziplab
 
 #endif // ZIPLAB_RANS_RANSENCODER_HPP
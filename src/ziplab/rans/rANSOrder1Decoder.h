@@ -0,0 +1,259 @@
+#ifndef ZIPLAB_RANS_RANSORDER1DECODER_HPP
+#define ZIPLAB_RANS_RANSORDER1DECODER_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/rans/rANS.h"
+
+#include "ziplab/stream/MemoryBuffer.h"
+#include "ziplab/stream/InputStream.h"
+
+namespace ziplab {
+
+//
+// Decoder of the order-1 context rANS, see rANSOrder1Encoder for the format.
+// The template arguments must be the same as the encoder that produced the data.
+//
+// Only the used contexts get a slot table, so the memory is proportional
+// to the number of the used contexts.
+//
+template <typename CharT, std::size_t NumStates = 4, std::size_t ScaleBits = 12,
+          typename StateT = std::uint64_t, typename WordT = std::uint32_t>
+class rANSOrder1Decoder {
+public:
+    using char_type = CharT;
+    using size_type = std::size_t;
+    using ssize_type = std::intptr_t;
+
+    using traits_type = rANSTraits<ScaleBits, StateT, WordT>;
+    using state_type  = StateT;
+    using word_type   = WordT;
+
+    static const size_type     kScaleBits  = traits_type::kScaleBits;
+    static const std::uint32_t kTotalFreq  = traits_type::kTotalFreq;
+    static const std::uint32_t kScaleMask  = traits_type::kScaleMask;
+    static const size_type     kWordBits   = traits_type::kWordBits;
+    static const state_type    kLowerBound = traits_type::kLowerBound;
+    static const state_type    kInitState  = kLowerBound;
+
+    static const size_type kNumStates   = NumStates;
+    static const size_type kNumContexts = kSymbolTotal;
+
+    static_assert((NumStates == 1 || NumStates == 2 || NumStates == 4 || NumStates == 8),
+                  "rANSOrder1Decoder: NumStates must be 1, 2, 4 or 8");
+
+    using Symbol = std::uint8_t;
+
+private:
+    // The table index of each context
+    std::uint32_t context_index_[kNumContexts];
+    // The symbol of each slot, kTotalFreq slots per used context
+    std::vector<Symbol> cum2sym_;
+    // The freq and cumul of each symbol, kSymbolTotal symbols per used context
+    std::vector<SymbolInfo> infos_;
+
+public:
+    rANSOrder1Decoder() {
+        //
+    }
+
+    virtual ~rANSOrder1Decoder() {
+        //
+    }
+
+private:
+    bool read_contexts(InputStream & input_is, size_type & num_used) {
+        // An unused context never occurs in valid data, it's mapped to
+        // the first table only to keep the corrupted data in bounds.
+        for (size_type context = 0; context < kNumContexts; context++) {
+            context_index_[context] = 0;
+        }
+
+        std::uint8_t num_runs;
+        if (!input_is.readUInt8(num_runs))
+            return false;
+
+        num_used = 0;
+        size_type next_context = 0;
+        for (size_type run = 0; run < num_runs; run++) {
+            std::uint8_t first, length;
+            if (!input_is.readUInt8(first) || !input_is.readUInt8(length))
+                return false;
+            size_type last = static_cast<size_type>(first) + length;
+            if (first < next_context || last >= kNumContexts)
+                return false;
+            for (size_type context = first; context <= last; context++) {
+                context_index_[context] = static_cast<std::uint32_t>(num_used++);
+            }
+            next_context = last + 1;
+        }
+        return (num_used != 0);
+    }
+
+    bool read_symbol_stats(InputStream & input_is, SymbolInfo * infos, Symbol * cum2sym) {
+        // Read symbol range: [min_symbol, max_symbol]
+        std::uint8_t min_symbol, max_symbol;
+        if (!input_is.readUInt8(min_symbol) || !input_is.readUInt8(max_symbol))
+            return false;
+        if (min_symbol > max_symbol)
+            return false;
+
+        // Read symbol scaled frequencies, 7 bits per byte, low bits first,
+        // a zero frequency is followed by the count of the extra zeros.
+        std::uint32_t cumul = 0;
+        for (size_type symbol = min_symbol; symbol <= max_symbol; symbol++) {
+            std::uint32_t freq = 0;
+            std::uint8_t byte;
+            std::uint32_t shift = 0;
+            do {
+                if (!input_is.readUInt8(byte) || (shift > 14))
+                    return false;
+                freq |= static_cast<std::uint32_t>(byte & 0x7Fu) << shift;
+                shift += 7;
+            } while ((byte & 0x80u) != 0);
+
+            if (freq != 0) {
+                if (freq > (kTotalFreq - cumul))
+                    return false;
+                infos[symbol].freq = freq;
+                infos[symbol].cumul = cumul;
+                for (std::uint32_t slot = cumul; slot < cumul + freq; slot++) {
+                    cum2sym[slot] = static_cast<Symbol>(symbol);
+                }
+                cumul += freq;
+            } else {
+                std::uint8_t zeros;
+                if (!input_is.readUInt8(zeros))
+                    return false;
+                symbol += zeros;
+            }
+        }
+        return (cumul == kTotalFreq);
+    }
+
+public:
+    //
+    // Running out of the input words is reported by underrun,
+    // the data has been truncated.
+    //
+    ZIPLAB_FORCED_INLINE
+    state_type decode(const SymbolInfo * infos, const Symbol * cum2sym, state_type state,
+                      Symbol & symbol, InputStream & input_is, bool & underrun) {
+        std::uint32_t slot = static_cast<std::uint32_t>(state & kScaleMask);
+        symbol = cum2sym[slot];
+
+        const SymbolInfo & info = infos[symbol];
+        state_type nextState = (state >> kScaleBits) * info.freq + (slot - info.cumul);
+
+        // Normalize, the words are read straight from the input
+        while (nextState < kLowerBound) {
+            word_type word;
+            if (input_is.readValue(word)) {
+                nextState = (nextState << kWordBits) | word;
+            } else {
+                underrun = true;
+                break;
+            }
+        }
+
+        return nextState;
+    }
+
+    int decompress(MemoryBuffer & compressed_data, MemoryBuffer & decompressed_data) {
+        int err_code = 0;
+        InputStream input_is(compressed_data);
+
+        size_type data_size = compressed_data.size();
+        if (ziplab_likely(data_size != 0)) {
+            size_type num_used;
+            if (!read_contexts(input_is, num_used))
+                return -1;
+
+            cum2sym_.assign(num_used * kTotalFreq, 0);
+            infos_.assign(num_used * kSymbolTotal, SymbolInfo());
+            for (size_type n = 0; n < num_used; n++) {
+                if (!read_symbol_stats(input_is, &infos_[n * kSymbolTotal], &cum2sym_[n * kTotalFreq]))
+                    return -1;
+            }
+
+            std::uint32_t content_size, compressed_size;
+            if (!input_is.readUInt32(content_size) || !input_is.readUInt32(compressed_size))
+                return -1;
+
+            if ((compressed_size < NumStates * sizeof(state_type)) ||
+                (compressed_size > (data_size - input_is.npos())))
+                return -1;
+
+            size_type compressed_end = input_is.npos() + compressed_size;
+
+            state_type states[NumStates];
+            Symbol contexts[NumStates];
+            for (size_type n = 0; n < NumStates; n++) {
+                if (!input_is.readValue(states[n]))
+                    return -1;
+                contexts[n] = 0;
+            }
+
+            decompressed_data.grow(content_size);
+            Symbol * output = reinterpret_cast<Symbol *>(decompressed_data.current());
+
+            // Decode one symbol of each segment in turn, all the segments
+            // are full in the first (tail_size) rounds.
+            size_type segment_size = (content_size + NumStates - 1) / NumStates;
+            size_type tail_size = content_size - (NumStates - 1) * segment_size;
+            if (content_size < (NumStates - 1) * segment_size)
+                tail_size = 0;
+
+            bool underrun = false;
+            size_type i = 0;
+            for (; i < tail_size; i++) {
+                Symbol symbols[NumStates];
+                for (size_type n = 0; n < NumStates; n++) {
+                    size_type index = context_index_[contexts[n]];
+                    states[n] = decode(&infos_[index * kSymbolTotal], &cum2sym_[index * kTotalFreq],
+                                       states[n], symbols[n], input_is, underrun);
+                    contexts[n] = symbols[n];
+                }
+                for (size_type n = 0; n < NumStates; n++) {
+                    output[n * segment_size + i] = symbols[n];
+                }
+            }
+            for (; i < segment_size; i++) {
+                for (size_type n = 0; n < NumStates; n++) {
+                    size_type pos = n * segment_size + i;
+                    if (pos < content_size) {
+                        size_type index = context_index_[contexts[n]];
+                        Symbol symbol;
+                        states[n] = decode(&infos_[index * kSymbolTotal], &cum2sym_[index * kTotalFreq],
+                                           states[n], symbol, input_is, underrun);
+                        output[pos] = symbol;
+                        contexts[n] = symbol;
+                    }
+                }
+            }
+            if (ziplab_unlikely(underrun))
+                return -1;
+
+            // All the compressed data must be consumed, and the states are back to the initial state
+            if (input_is.npos() != compressed_end)
+                return -1;
+            for (size_type n = 0; n < NumStates; n++) {
+                if (states[n] != kInitState)
+                    return -1;
+            }
+
+            decompressed_data.forward(content_size);
+        }
+
+        return err_code;
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_RANS_RANSORDER1DECODER_HPP
@@ -0,0 +1,263 @@
+#ifndef ZIPLAB_RANS_RANSORDER1ENCODER_HPP
+#define ZIPLAB_RANS_RANSORDER1ENCODER_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>      // For std::memcpy()
+#include <vector>
+#include <string>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/rans/rANS.h"
+
+#include "ziplab/stream/MemoryBuffer.h"
+#include "ziplab/stream/OutputStream.h"
+
+namespace ziplab {
+
+//
+// Order-1 context rANS: the frequency table of each symbol is selected by
+// the previous byte (the context).
+//
+// The input is split into NumStates segments of the same length (the last
+// one may be shorter), each segment is coded by its own state and starts
+// with the context 0, so the segments are decoded independently and their
+// states interleave in one word stream.
+//
+// Format:
+//   [number of context runs: 1][context run: (first: 1, length - 1: 1) * runs]
+//   [table: (min_symbol: 1, max_symbol: 1, freq: varint * N) * used contexts]
+//   [content size: 4][compressed size: 4]
+//   [states: sizeof(StateT) * NumStates][words: sizeof(WordT) * N]
+//
+// The used contexts are written as runs of consecutive contexts. In a table,
+// a zero frequency is followed by the count of the extra zeros (1 byte).
+// The compressed size is the size of the states and the words in bytes.
+//
+template <typename CharT, std::size_t NumStates = 4, std::size_t ScaleBits = 12,
+          typename StateT = std::uint64_t, typename WordT = std::uint32_t>
+class rANSOrder1Encoder {
+public:
+    using char_type = CharT;
+    using size_type = std::size_t;
+    using ssize_type = std::intptr_t;
+
+    using traits_type = rANSTraits<ScaleBits, StateT, WordT>;
+    using state_type  = StateT;
+    using word_type   = WordT;
+
+    using reciprocal_type = rANSReciprocal<StateT>;
+
+    static const size_type     kScaleBits  = traits_type::kScaleBits;
+    static const std::uint32_t kTotalFreq  = traits_type::kTotalFreq;
+    static const size_type     kWordBits   = traits_type::kWordBits;
+    static const state_type    kLowerBound = traits_type::kLowerBound;
+    static const state_type    kInitState  = kLowerBound;
+
+    static const size_type kNumStates   = NumStates;
+    static const size_type kNumContexts = kSymbolTotal;
+
+    static_assert((NumStates == 1 || NumStates == 2 || NumStates == 4 || NumStates == 8),
+                  "rANSOrder1Encoder: NumStates must be 1, 2, 4 or 8");
+
+    using Symbol = std::uint8_t;
+
+private:
+    // The frequencies of each context, kSymbolTotal symbols per context
+    std::vector<std::uint32_t> freqs_;
+    // The table of each context, a context gets its table when it's first used,
+    // and the tables are reused by the next calls.
+    std::vector<SymbolStats> stats_;
+
+public:
+    rANSOrder1Encoder() : stats_(kNumContexts, SymbolStats(0)) {
+        //
+    }
+
+    virtual ~rANSOrder1Encoder() {
+        //
+    }
+
+private:
+    static void count_freq(const std::string & input_data, size_type segment_size,
+                           std::vector<std::uint32_t> & freqs) {
+        const Symbol * data = reinterpret_cast<const Symbol *>(input_data.data());
+        size_type data_size = input_data.size();
+
+        freqs.assign(kNumContexts * kSymbolTotal, 0);
+        for (size_type first = 0; first < data_size; first += segment_size) {
+            size_type last = (std::min)(first + segment_size, data_size);
+            Symbol context = 0;
+            for (size_type i = first; i < last; i++) {
+                freqs[context * kSymbolTotal + data[i]]++;
+                context = data[i];
+            }
+        }
+    }
+
+    bool init_symbol_stats(SymbolStats & stats, const std::uint32_t * freqs) {
+        if (!normalize_symbol_stats(stats, freqs, kSymbolTotal, kTotalFreq))
+            return false;
+
+        // Precompute the reciprocal of the frequencies
+        for (size_type symbol = stats.min_symbol; symbol <= stats.max_symbol; symbol++) {
+            if (stats.symbols[symbol].freq != 0) {
+                reciprocal_type::init(stats.symbols[symbol], static_cast<std::uint32_t>(kScaleBits));
+            }
+        }
+        return true;
+    }
+
+    void write_contexts(const bool * used, OutputStream & output_os) {
+        std::uint8_t runs[kNumContexts];
+        size_type num_runs = 0;
+        for (size_type context = 0; context < kNumContexts; ) {
+            if (used[context]) {
+                size_type first = context;
+                while (context < kNumContexts && used[context])
+                    context++;
+                runs[num_runs++] = static_cast<std::uint8_t>(first);
+                runs[num_runs++] = static_cast<std::uint8_t>(context - first - 1);
+            } else {
+                context++;
+            }
+        }
+
+        // At most 128 runs, because the runs are separated by unused contexts
+        output_os.reserve(output_os.size() + 1 + num_runs);
+        output_os.unsafeWriteUInt8(static_cast<std::uint8_t>(num_runs / 2));
+        output_os.unsafeWrite(reinterpret_cast<const char *>(runs), num_runs);
+    }
+
+    void write_symbol_stats(const SymbolStats & stats, OutputStream & output_os) {
+        // Write symbol range: [min_symbol, max_symbol]
+        output_os.writeUInt8(stats.min_symbol);
+        output_os.writeUInt8(stats.max_symbol);
+
+        // Write symbol scaled frequencies, 7 bits per byte, low bits first
+        for (size_type symbol = stats.min_symbol; symbol <= stats.max_symbol; symbol++) {
+            std::uint32_t freq = stats.symbols[symbol].freq;
+            if (freq != 0) {
+                while (freq >= 0x80u) {
+                    output_os.writeUInt8(static_cast<std::uint8_t>(freq | 0x80u));
+                    freq >>= 7;
+                }
+                output_os.writeUInt8(static_cast<std::uint8_t>(freq));
+            } else {
+                // A run of zeros, the max_symbol is present, so the run ends before it
+                size_type zeros = 0;
+                while (stats.symbols[symbol + zeros + 1].freq == 0 && zeros < 255)
+                    zeros++;
+                output_os.writeUInt8(0);
+                output_os.writeUInt8(static_cast<std::uint8_t>(zeros));
+                symbol += zeros;
+            }
+        }
+    }
+
+public:
+    ZIPLAB_FORCED_INLINE
+    state_type encode(const SymbolStat & stat, state_type state,
+                      std::vector<word_type> & words) {
+        std::uint32_t freq = stat.freq;
+
+        // Normalize
+        state_type max_state = ((kLowerBound >> kScaleBits) << kWordBits) * freq;
+        while (state >= max_state) {
+            words.push_back(static_cast<word_type>(state));
+            state >>= kWordBits;
+        }
+
+        // nextState = (state / freq) * kTotalFreq + (state % freq) + cumul
+        state_type quotient = reciprocal_type::quotient(state, stat);
+        return (state + stat.bias + quotient * (kTotalFreq - freq));
+    }
+
+    int compress(const std::string & input_data, MemoryBuffer & compressed_data) {
+        int err_code = 0;
+        OutputStream output_os(compressed_data);
+
+        size_type data_size = input_data.size();
+        if (ziplab_likely(data_size != 0)) {
+            size_type segment_size = (data_size + NumStates - 1) / NumStates;
+
+            std::vector<std::uint32_t> & freqs = freqs_;
+            count_freq(input_data, segment_size, freqs);
+
+            bool used[kNumContexts];
+            for (size_type context = 0; context < kNumContexts; context++) {
+                const std::uint32_t * context_freqs = &freqs[context * kSymbolTotal];
+                used[context] = false;
+                for (size_type symbol = 0; symbol < kSymbolTotal; symbol++) {
+                    if (context_freqs[symbol] != 0) {
+                        used[context] = true;
+                        break;
+                    }
+                }
+            }
+            write_contexts(used, output_os);
+
+            // The tables of the unused contexts aren't touched
+            std::vector<SymbolStats> & stats = stats_;
+            for (size_type context = 0; context < kNumContexts; context++) {
+                if (used[context]) {
+                    if (stats[context].symbols.size() <= kSymbolTotal)
+                        stats[context] = SymbolStats(kSymbolTotal);
+                    if (!init_symbol_stats(stats[context], &freqs[context * kSymbolTotal]))
+                        return -1;
+                    write_symbol_stats(stats[context], output_os);
+                }
+            }
+
+            // Write the content size
+            output_os.writeUInt32(static_cast<std::uint32_t>(data_size));
+            // Write the compressed data size, fill it after encoding
+            size_type compressed_size_pos = compressed_data.size();
+            output_os.writeUInt32(0);
+
+            size_type compressed_start = compressed_data.size();
+
+            std::vector<word_type> words;
+            words.reserve(data_size / sizeof(word_type) + 1);
+
+            // Encode in reverse order of the decoder, which decodes one symbol
+            // of each segment in turn.
+            const Symbol * data = reinterpret_cast<const Symbol *>(input_data.data());
+            state_type states[NumStates];
+            for (size_type n = 0; n < NumStates; n++) {
+                states[n] = kInitState;
+            }
+            for (size_type i = segment_size; i > 0; i--) {
+                for (size_type n = NumStates; n > 0; n--) {
+                    size_type pos = (n - 1) * segment_size + (i - 1);
+                    if (pos < data_size) {
+                        Symbol context = (i > 1) ? data[pos - 1] : 0;
+                        const SymbolStat & stat = stats[context].symbols[data[pos]];
+                        states[n - 1] = encode(stat, states[n - 1], words);
+                    }
+                }
+            }
+
+            for (size_type n = 0; n < NumStates; n++) {
+                output_os.writeValue(states[n]);
+            }
+
+            // Write the words in the order of decoding
+            output_os.reserve(output_os.size() + words.size() * sizeof(word_type));
+            for (auto iter = words.rbegin(); iter != words.rend(); ++iter) {
+                output_os.writeValue(*iter);
+            }
+
+            std::uint32_t compressed_size = static_cast<std::uint32_t>(compressed_data.size() - compressed_start);
+            std::memcpy(compressed_data.data() + compressed_size_pos, &compressed_size, sizeof(compressed_size));
+        }
+
+        return err_code;
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_RANS_RANSORDER1ENCODER_HPP
@@ -0,0 +1,277 @@
+#ifndef ZIPLAB_RANS_RANSSIMDDECODER_HPP
+#define ZIPLAB_RANS_RANSSIMDDECODER_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>      // For std::memcpy()
+#include <vector>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/arch/cpu_features.h"
+#include "ziplab/rans/rANS.h"
+
+#include "ziplab/stream/MemoryBuffer.h"
+#include "ziplab/stream/InputStream.h"
+
+namespace ziplab {
+
+//
+// Decoder of the 32-bit state, NumLanes-way interleaved rANS,
+// see rANSSimdEncoder32 for the format.
+//
+// When the CPU supports AVX2, the states are decoded 8 lanes per register:
+// the slot entries are fetched with one gather, and the lanes which need
+// a new word are renormalized with a compare, a permute and a blend.
+// The remaining symbols are decoded by the scalar loop.
+//
+template <typename CharT, std::size_t NumLanes = 8>
+class rANSSimdDecoder32 {
+public:
+    using char_type = CharT;
+    using size_type = std::size_t;
+    using ssize_type = std::intptr_t;
+
+    static const size_type kScaleBits  = 12;
+    static const size_type kTotalFreq  = size_type(1) << kScaleBits;
+    static const size_type kSlotMask   = kTotalFreq - 1;
+    static const size_type kLowerBound = size_type(1) << 16;
+    static const size_type kInitState  = kLowerBound;
+    static const size_type kNumLanes   = NumLanes;
+
+    // Slot entry: [freq - 1: 12 bits][bias: 12 bits][symbol: 8 bits]
+    static const std::uint32_t kFieldBits = 12;
+    static const std::uint32_t kFieldMask = (1u << kFieldBits) - 1;
+
+    static_assert((NumLanes == 8 || NumLanes == 16 || NumLanes == 32),
+                  "rANSSimdDecoder32: NumLanes must be 8, 16 or 32");
+    static_assert((kScaleBits <= kFieldBits),
+                  "rANSSimdDecoder32: kScaleBits must be less than or equal to kFieldBits");
+
+    using Symbol = std::uint8_t;
+
+private:
+    std::vector<std::uint32_t> slot_table_;
+    bool simd_enabled_;
+
+    // For each 8-lane renormalization mask, the word index of each lane
+    // and the number of words consumed.
+    struct RenormTable {
+        alignas(32) std::uint32_t permute[256][8];
+        std::uint32_t count[256];
+
+        RenormTable() {
+            for (std::uint32_t mask = 0; mask < 256; mask++) {
+                std::uint32_t index = 0;
+                for (std::uint32_t lane = 0; lane < 8; lane++) {
+                    permute[mask][lane] = index;
+                    if ((mask & (1u << lane)) != 0)
+                        index++;
+                }
+                count[mask] = index;
+            }
+        }
+    };
+
+public:
+    rANSSimdDecoder32(bool simd_enabled = true)
+        : slot_table_(kTotalFreq), simd_enabled_(simd_enabled) {
+    }
+
+    virtual ~rANSSimdDecoder32() {
+        //
+    }
+
+    // Whether decompress() uses the AVX2 decoder.
+    bool isSimdEnabled() const {
+#if defined(ZIPLAB_CAN_TARGET_AVX2)
+        return (simd_enabled_ && cpu_has_avx2());
+#else
+        return false;
+#endif
+    }
+
+    void setSimdEnabled(bool simd_enabled) {
+        simd_enabled_ = simd_enabled;
+    }
+
+private:
+    bool read_symbol_stats(InputStream & input_is) {
+        std::uint8_t min_symbol, max_symbol;
+        if (!input_is.readUInt8(min_symbol) || !input_is.readUInt8(max_symbol))
+            return false;
+        if (min_symbol > max_symbol)
+            return false;
+
+        std::uint32_t cumul = 0;
+        for (std::uint32_t symbol = min_symbol; symbol <= max_symbol; symbol++) {
+            std::uint16_t freq;
+            if (!input_is.readUInt16(freq))
+                return false;
+            if (freq > (kTotalFreq - cumul))
+                return false;
+            for (std::uint32_t bias = 0; bias < freq; bias++) {
+                slot_table_[cumul + bias] = (freq - 1u) | (bias << kFieldBits) | (symbol << 24);
+            }
+            cumul += freq;
+        }
+        return (cumul == kTotalFreq);
+    }
+
+    static const RenormTable & renorm_table() {
+        static const RenormTable table;
+        return table;
+    }
+
+    static inline std::uint32_t load_u16(const std::uint8_t * ptr) {
+        std::uint16_t word;
+        std::memcpy(&word, ptr, sizeof(word));
+        return word;
+    }
+
+    static bool decode_scalar(const std::uint32_t * slot_table, std::uint32_t * states,
+                              std::uint8_t * output, size_type i, size_type content_size,
+                              const std::uint8_t * & words, const std::uint8_t * words_end) {
+        for (; i < content_size; i++) {
+            std::uint32_t & state = states[i % NumLanes];
+            std::uint32_t entry = slot_table[state & kSlotMask];
+            std::uint32_t freq = (entry & kFieldMask) + 1;
+            std::uint32_t bias = (entry >> kFieldBits) & kFieldMask;
+            state = freq * (state >> kScaleBits) + bias;
+            output[i] = static_cast<std::uint8_t>(entry >> 24);
+
+            // Renormalize
+            if (state < kLowerBound) {
+                if (ziplab_unlikely(words >= words_end))
+                    return false;
+                state = (state << 16) | load_u16(words);
+                words += sizeof(std::uint16_t);
+            }
+        }
+        return true;
+    }
+
+#if defined(ZIPLAB_CAN_TARGET_AVX2)
+
+    // Return the number of the decoded symbols, it's a multiple of NumLanes.
+    ZIPLAB_TARGET_AVX2
+    static size_type decode_avx2(const std::uint32_t * slot_table, std::uint32_t * states,
+                                 std::uint8_t * output, size_type content_size,
+                                 const std::uint8_t * & words, const std::uint8_t * words_end) {
+        static const size_type kNumVectors = NumLanes / 8;
+        const RenormTable & renorm = renorm_table();
+
+        __m256i xs[kNumVectors];
+        for (size_type v = 0; v < kNumVectors; v++) {
+            xs[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(states + v * 8));
+        }
+
+        const __m256i slot_mask  = _mm256_set1_epi32(static_cast<int>(kSlotMask));
+        const __m256i field_mask = _mm256_set1_epi32(static_cast<int>(kFieldMask));
+        const __m256i one        = _mm256_set1_epi32(1);
+        const __m256i zero       = _mm256_setzero_si256();
+
+        // Gather the symbol bytes (the highest byte of each entry) to the low 8 bytes
+        const __m256i symbol_shuffle = _mm256_setr_epi8(
+            3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m256i symbol_permute = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+
+        size_type i = 0;
+        // Each group consumes NumLanes words at most, and each vector loads 8 words.
+        while (((content_size - i) >= NumLanes) &&
+               (static_cast<size_type>(words_end - words) >= NumLanes * sizeof(std::uint16_t))) {
+            for (size_type v = 0; v < kNumVectors; v++) {
+                __m256i x = xs[v];
+                __m256i slot = _mm256_and_si256(x, slot_mask);
+                __m256i entry = _mm256_i32gather_epi32(reinterpret_cast<const int *>(slot_table), slot, 4);
+
+                __m256i freq = _mm256_add_epi32(_mm256_and_si256(entry, field_mask), one);
+                __m256i bias = _mm256_and_si256(_mm256_srli_epi32(entry, kFieldBits), field_mask);
+                x = _mm256_add_epi32(_mm256_mullo_epi32(freq, _mm256_srli_epi32(x, kScaleBits)), bias);
+
+                __m256i symbols = _mm256_permutevar8x32_epi32(
+                                    _mm256_shuffle_epi8(entry, symbol_shuffle), symbol_permute);
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(output + i + v * 8),
+                                 _mm256_castsi256_si128(symbols));
+
+                // Renormalize the lanes whose state < kLowerBound
+                __m256i need_word = _mm256_cmpeq_epi32(_mm256_srli_epi32(x, 16), zero);
+                int mask = _mm256_movemask_ps(_mm256_castsi256_ps(need_word));
+
+                __m256i new_words = _mm256_cvtepu16_epi32(
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i *>(words)));
+                __m256i permute = _mm256_load_si256(reinterpret_cast<const __m256i *>(renorm.permute[mask]));
+                new_words = _mm256_permutevar8x32_epi32(new_words, permute);
+
+                __m256i renormed = _mm256_or_si256(_mm256_slli_epi32(x, 16), new_words);
+                xs[v] = _mm256_blendv_epi8(x, renormed, need_word);
+                words += renorm.count[mask] * sizeof(std::uint16_t);
+            }
+            i += NumLanes;
+        }
+
+        for (size_type v = 0; v < kNumVectors; v++) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(states + v * 8), xs[v]);
+        }
+        return i;
+    }
+
+#endif // ZIPLAB_CAN_TARGET_AVX2
+
+public:
+    int decompress(MemoryBuffer & compressed_data, MemoryBuffer & decompressed_data) {
+        int err_code = 0;
+        InputStream input_is(compressed_data);
+
+        size_type data_size = compressed_data.size();
+        if (ziplab_likely(data_size != 0)) {
+            if (!read_symbol_stats(input_is))
+                return -1;
+
+            std::uint32_t content_size, compressed_size;
+            if (!input_is.readUInt32(content_size) || !input_is.readUInt32(compressed_size))
+                return -1;
+            if ((compressed_size < NumLanes * sizeof(std::uint32_t)) ||
+                (compressed_size > (data_size - input_is.npos())))
+                return -1;
+
+            const std::uint8_t * payload =
+                reinterpret_cast<const std::uint8_t *>(compressed_data.data() + input_is.pos());
+            std::uint32_t states[NumLanes];
+            std::memcpy(states, payload, sizeof(states));
+
+            const std::uint8_t * words = payload + sizeof(states);
+            const std::uint8_t * words_end = payload + compressed_size;
+
+            decompressed_data.grow(content_size);
+            std::uint8_t * output = reinterpret_cast<std::uint8_t *>(decompressed_data.current());
+
+            size_type i = 0;
+#if defined(ZIPLAB_CAN_TARGET_AVX2)
+            if (isSimdEnabled()) {
+                i = decode_avx2(slot_table_.data(), states, output, content_size, words, words_end);
+            }
+#endif
+            if (!decode_scalar(slot_table_.data(), states, output, i, content_size, words, words_end))
+                return -1;
+
+            // All the words must be consumed, and the lanes are back to the initial state
+            if (words != words_end)
+                return -1;
+            for (size_type n = 0; n < NumLanes; n++) {
+                if (states[n] != kInitState)
+                    return -1;
+            }
+
+            decompressed_data.forward(content_size);
+        }
+
+        return err_code;
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_RANS_RANSSIMDDECODER_HPP
@@ -0,0 +1,135 @@
+#ifndef ZIPLAB_RANS_RANSSIMDENCODER_HPP
+#define ZIPLAB_RANS_RANSSIMDENCODER_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/rans/rANS.h"
+#include "ziplab/entropy/Histogram.h"
+
+#include "ziplab/stream/MemoryBuffer.h"
+#include "ziplab/stream/OutputStream.h"
+
+namespace ziplab {
+
+//
+// Scalar encoder of the 32-bit state, NumLanes-way interleaved rANS.
+//
+// Each state lives in [kLowerBound, kLowerBound << 16) and renormalizes
+// with 16-bit words, the symbol i is coded by the lane (i % NumLanes).
+// The words are laid out in the order the decoder consumes them,
+// so rANSSimdDecoder32 can decode 8 lanes per AVX2 register.
+//
+// Format:
+//   [min_symbol: 1][max_symbol: 1][freq: 2 * (max - min + 1)]
+//   [content size: 4][compressed size: 4]
+//   [states: 4 * NumLanes][words: 2 * N]
+//
+// The compressed size is the size of the states and the words in bytes.
+//
+template <typename CharT, std::size_t NumLanes = 8>
+class rANSSimdEncoder32 {
+public:
+    using char_type = CharT;
+    using size_type = std::size_t;
+    using ssize_type = std::intptr_t;
+
+    static const size_type kScaleBits  = 12;
+    static const size_type kTotalFreq  = size_type(1) << kScaleBits;
+    static const size_type kLowerBound = size_type(1) << 16;
+    static const size_type kNumLanes   = NumLanes;
+
+    static_assert((NumLanes == 8 || NumLanes == 16 || NumLanes == 32),
+                  "rANSSimdEncoder32: NumLanes must be 8, 16 or 32");
+
+    using Symbol = std::uint8_t;
+
+public:
+    rANSSimdEncoder32() {
+        //
+    }
+
+    virtual ~rANSSimdEncoder32() {
+        //
+    }
+
+private:
+    void write_symbol_stats(const SymbolStats & stats, OutputStream & output_os) {
+        output_os.writeUInt8(stats.min_symbol);
+        output_os.writeUInt8(stats.max_symbol);
+
+        for (size_type symbol = stats.min_symbol; symbol <= stats.max_symbol; symbol++) {
+            output_os.writeUInt16(static_cast<std::uint16_t>(stats.symbols[symbol].freq));
+        }
+    }
+
+public:
+    ZIPLAB_FORCED_INLINE
+    std::uint32_t encode(const SymbolStat & stat, std::uint32_t state,
+                         std::uint16_t * & words) {
+        // Normalize
+        std::uint64_t max_state = static_cast<std::uint64_t>((kLowerBound >> kScaleBits) << 16) * stat.freq;
+        if (state >= max_state) {
+            *--words = static_cast<std::uint16_t>(state & 0xFFFFu);
+            state >>= 16;
+        }
+
+        return ((state / stat.freq) << kScaleBits) + (state % stat.freq) + stat.cumul;
+    }
+
+    int compress(const std::string & input_data, MemoryBuffer & compressed_data) {
+        int err_code = 0;
+        OutputStream output_os(compressed_data);
+
+        size_type data_size = input_data.size();
+        if (ziplab_likely(data_size != 0)) {
+            std::uint32_t freqs[kSymbolTotal];
+            count_histogram(input_data.data(), data_size, freqs);
+
+            SymbolStats stats(kSymbolTotal);
+            if (!normalize_symbol_stats(stats, freqs, kSymbolTotal,
+                                        static_cast<std::uint32_t>(kTotalFreq))) {
+                return -1;
+            }
+            write_symbol_stats(stats, output_os);
+
+            // Each symbol outputs one word at most, the words are written backward
+            std::vector<std::uint16_t> word_buf(data_size);
+            std::uint16_t * words_end = word_buf.data() + word_buf.size();
+            std::uint16_t * words = words_end;
+
+            std::uint32_t states[NumLanes];
+            for (size_type n = 0; n < NumLanes; n++) {
+                states[n] = static_cast<std::uint32_t>(kLowerBound);
+            }
+            for (size_type i = data_size; i > 0; i--) {
+                Symbol symbol = static_cast<Symbol>(input_data[i - 1]);
+                std::uint32_t & state = states[(i - 1) % NumLanes];
+                state = encode(stats.symbols[symbol], state, words);
+            }
+
+            size_type num_words = static_cast<size_type>(words_end - words);
+            size_type compressed_size = NumLanes * sizeof(std::uint32_t) + num_words * sizeof(std::uint16_t);
+
+            output_os.writeUInt32(static_cast<std::uint32_t>(data_size));
+            output_os.writeUInt32(static_cast<std::uint32_t>(compressed_size));
+
+            for (size_type n = 0; n < NumLanes; n++) {
+                output_os.writeUInt32(states[n]);
+            }
+
+            output_os.write(reinterpret_cast<const char *>(words), num_words * sizeof(std::uint16_t));
+        }
+
+        return err_code;
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_RANS_RANSSIMDENCODER_HPP
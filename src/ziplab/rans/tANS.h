@@ -0,0 +1,71 @@
+#ifndef ZIPLAB_RANS_TANS_H
+#define ZIPLAB_RANS_TANS_H
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include <assert.h>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/rans/rANS.h"
+
+namespace ziplab {
+
+//
+// The parameters of a tANS (FSE style) coder:
+//
+//   TableLog: the table has (1 << TableLog) states, it's also the
+//             probability scale of the normalized frequencies.
+//
+// The encoder states are in [kTableSize, 2 * kTableSize),
+// the decoder states are in [0, kTableSize).
+//
+template <std::size_t TableLog>
+struct tANSTraits {
+    static const std::size_t   kTableLog  = TableLog;
+    static const std::uint32_t kTableSize = std::uint32_t(1) << TableLog;
+    static const std::uint32_t kTableMask = kTableSize - 1;
+
+    // The state table is std::uint16_t, and a symbol outputs kTableLog bits at most
+    static_assert((TableLog >= 9 && TableLog <= 15),
+                  "tANSTraits: TableLog must be in [9, 15]");
+};
+
+// The index of the highest set bit, value must be nonzero.
+static inline
+std::uint32_t tans_highbit(std::uint32_t value)
+{
+    assert(value != 0);
+    std::uint32_t bit = 0;
+    while ((value >>= 1) != 0)
+        bit++;
+    return bit;
+}
+
+//
+// Spread the symbols over the table, the symbol s occupies stats.symbols[s].freq
+// positions. The step is odd, so it visits every position of the table once,
+// and it scatters the occurrences of each symbol across the table.
+//
+static inline
+void tans_spread_symbols(const SymbolStats & stats, std::uint32_t table_log, std::uint8_t * spread)
+{
+    std::uint32_t table_size = std::uint32_t(1) << table_log;
+    std::uint32_t table_mask = table_size - 1;
+    std::uint32_t step = (table_size >> 1) + (table_size >> 3) + 3;
+
+    std::uint32_t position = 0;
+    for (std::size_t symbol = stats.min_symbol; symbol <= stats.max_symbol; symbol++) {
+        for (std::uint32_t n = 0; n < stats.symbols[symbol].freq; n++) {
+            spread[position] = static_cast<std::uint8_t>(symbol);
+            position = (position + step) & table_mask;
+        }
+    }
+    assert(position == 0);
+}
+
+} // namespace ziplab
+
+#endif // ZIPLAB_RANS_TANS_H
@@ -0,0 +1,172 @@
+#ifndef ZIPLAB_RANS_TANSDECODER_HPP
+#define ZIPLAB_RANS_TANSDECODER_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/rans/rANS.h"
+#include "ziplab/rans/tANS.h"
+
+#include "ziplab/stream/MemoryBuffer.h"
+#include "ziplab/stream/InputStream.h"
+#include "ziplab/stream/ReverseBitReader.h"
+
+namespace ziplab {
+
+//
+// tANS (tabled ANS, FSE style) decoder, see tANSEncoder for the format.
+// The template arguments must be the same as the encoder that produced the data.
+//
+// Each state is an index of the decode table, decoding a symbol is one lookup
+// plus reading nbBits bits: state = entry.new_state + read(entry.nbbits).
+//
+template <typename CharT, std::size_t NumStates = 4, std::size_t TableLog = 11>
+class tANSDecoder {
+public:
+    using char_type = CharT;
+    using size_type = std::size_t;
+    using ssize_type = std::intptr_t;
+
+    using traits_type = tANSTraits<TableLog>;
+    using state_type  = std::uint32_t;
+
+    static const size_type     kTableLog  = traits_type::kTableLog;
+    static const std::uint32_t kTableSize = traits_type::kTableSize;
+    static const size_type     kNumStates = NumStates;
+
+    static_assert((NumStates == 1 || NumStates == 2 || NumStates == 4),
+                  "tANSDecoder: NumStates must be 1, 2 or 4");
+
+    using Symbol = std::uint8_t;
+
+    struct DecodeEntry {
+        std::uint16_t new_state;
+        std::uint8_t  symbol;
+        std::uint8_t  nbbits;
+    };
+
+private:
+    std::vector<DecodeEntry> decode_table_;
+
+public:
+    tANSDecoder() : decode_table_(kTableSize) {
+        //
+    }
+
+    virtual ~tANSDecoder() {
+        //
+    }
+
+private:
+    bool read_symbol_stats(SymbolStats & stats, InputStream & input_is) {
+        // Read symbol range: [min_symbol, max_symbol]
+        if (!input_is.readUInt8(stats.min_symbol) || !input_is.readUInt8(stats.max_symbol))
+            return false;
+        if (stats.min_symbol > stats.max_symbol)
+            return false;
+
+        // Read symbol scaled frequencies, 7 bits per byte, low bits first
+        std::uint32_t total_freq = 0;
+        for (size_type symbol = stats.min_symbol; symbol <= (size_type)stats.max_symbol; symbol++) {
+            std::uint32_t freq = 0;
+            std::uint8_t byte;
+            std::uint32_t shift = 0;
+            do {
+                if (!input_is.readUInt8(byte) || (shift > 14))
+                    return false;
+                freq |= static_cast<std::uint32_t>(byte & 0x7Fu) << shift;
+                shift += 7;
+            } while ((byte & 0x80u) != 0);
+
+            if (freq > (kTableSize - total_freq))
+                return false;
+            stats.symbols[symbol].freq = freq;
+            total_freq += freq;
+        }
+        return (total_freq == kTableSize);
+    }
+
+    void build_table(const SymbolStats & stats) {
+        std::vector<std::uint8_t> spread(kTableSize);
+        tans_spread_symbols(stats, static_cast<std::uint32_t>(kTableLog), spread.data());
+
+        // The k-th occurrence of a symbol in the spread order is reached from
+        // the encoder state (freq + k) << nbBits, the same order as tANSEncoder.
+        std::uint32_t next_state[kSymbolTotal];
+        for (size_type symbol = 0; symbol < kSymbolTotal; symbol++) {
+            next_state[symbol] = stats.symbols[symbol].freq;
+        }
+        for (std::uint32_t position = 0; position < kTableSize; position++) {
+            Symbol symbol = spread[position];
+            std::uint32_t state = next_state[symbol]++;
+            std::uint32_t nbbits = static_cast<std::uint32_t>(kTableLog) - tans_highbit(state);
+
+            DecodeEntry & entry = decode_table_[position];
+            entry.symbol = symbol;
+            entry.nbbits = static_cast<std::uint8_t>(nbbits);
+            entry.new_state = static_cast<std::uint16_t>((state << nbbits) - kTableSize);
+        }
+    }
+
+public:
+    ZIPLAB_FORCED_INLINE
+    state_type decode(state_type state, Symbol & symbol, ReverseBitReader & reader) {
+        const DecodeEntry & entry = decode_table_[state];
+        symbol = entry.symbol;
+        return (entry.new_state + static_cast<state_type>(reader.read(entry.nbbits)));
+    }
+
+    int decompress(MemoryBuffer & compressed_data, MemoryBuffer & decompressed_data) {
+        int err_code = 0;
+        InputStream input_is(compressed_data);
+
+        size_type data_size = compressed_data.size();
+        if (ziplab_likely(data_size != 0)) {
+            SymbolStats stats(kSymbolTotal);
+            if (!read_symbol_stats(stats, input_is))
+                return -1;
+            build_table(stats);
+
+            std::uint32_t content_size, bit_count;
+            if (!input_is.readUInt32(content_size) || !input_is.readUInt32(bit_count))
+                return -1;
+
+            size_type bits_size = data_size - input_is.npos();
+            if ((bit_count < NumStates * kTableLog) || (bit_count > bits_size * 8))
+                return -1;
+
+            ReverseBitReader reader(compressed_data.data() + input_is.pos(), bits_size, bit_count);
+
+            // The final states of the encoder were written last
+            state_type states[NumStates];
+            for (size_type n = NumStates; n > 0; n--) {
+                states[n - 1] = static_cast<state_type>(reader.read(kTableLog));
+            }
+
+            decompressed_data.grow(content_size);
+            Symbol * output = reinterpret_cast<Symbol *>(decompressed_data.current());
+
+            // The symbol i uses the state (i % NumStates)
+            for (size_type i = 0; i < content_size; i++) {
+                state_type & state = states[i % NumStates];
+                state = decode(state, output[i], reader);
+            }
+
+            // All the bits must be consumed exactly
+            if (reader.is_overflow() || (reader.bitpos() != 0))
+                return -1;
+
+            decompressed_data.forward(content_size);
+        }
+
+        return err_code;
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_RANS_TANSDECODER_HPP
@@ -0,0 +1,211 @@
+#ifndef ZIPLAB_RANS_TANSENCODER_HPP
+#define ZIPLAB_RANS_TANSENCODER_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>      // For std::memcpy()
+#include <vector>
+#include <string>
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/rans/rANS.h"
+#include "ziplab/rans/tANS.h"
+#include "ziplab/entropy/Histogram.h"
+
+#include "ziplab/stream/MemoryBuffer.h"
+#include "ziplab/stream/OutputStream.h"
+#include "ziplab/stream/BitWriter.h"
+
+namespace ziplab {
+
+//
+// tANS (tabled ANS, FSE style) encoder. The frequencies are counted and
+// normalized the same way as rANSEncoder, then the symbols are spread over
+// a table of (1 << TableLog) states. Encoding a symbol only outputs the low
+// bits of the state and looks up the next state, there is no multiplication.
+//
+// NumStates interleaved states share one bit stream, the symbol i uses the
+// state (i % NumStates). The symbols are encoded backward and the decoder
+// reads the bit stream backward (see ReverseBitReader), the final states are
+// the last (NumStates * TableLog) bits.
+//
+// Format:
+//   [min_symbol: 1][max_symbol: 1][freq: varint * (max - min + 1)]
+//   [content size: 4][bit count: 4][bits: (bit count + 7) / 8]
+//
+template <typename CharT, std::size_t NumStates = 4, std::size_t TableLog = 11>
+class tANSEncoder {
+public:
+    using char_type = CharT;
+    using size_type = std::size_t;
+    using ssize_type = std::intptr_t;
+
+    using traits_type = tANSTraits<TableLog>;
+    using state_type  = std::uint32_t;
+
+    static const size_type     kTableLog  = traits_type::kTableLog;
+    static const std::uint32_t kTableSize = traits_type::kTableSize;
+    static const size_type     kNumStates = NumStates;
+
+    // The number of symbols which can be put between two BitWriter::flush()
+    static const size_type kPutsPerFlush = BitWriter::kMaxPutBits / kTableLog;
+
+    static_assert((NumStates == 1 || NumStates == 2 || NumStates == 4),
+                  "tANSEncoder: NumStates must be 1, 2 or 4");
+
+    using Symbol = std::uint8_t;
+
+    struct SymbolTransform {
+        // nbBits = (state + delta_nbbits) >> 16
+        std::uint32_t delta_nbbits;
+        // The index of the next state is (state >> nbBits) + delta_find_state
+        std::int32_t  delta_find_state;
+    };
+
+private:
+    std::vector<std::uint16_t> state_table_;
+    SymbolTransform symbol_tt_[kSymbolTotal];
+
+public:
+    tANSEncoder() : state_table_(kTableSize) {
+        //
+    }
+
+    virtual ~tANSEncoder() {
+        //
+    }
+
+private:
+    void count_freq(const std::string & input_data, std::uint32_t * freqs, std::size_t freq_size) {
+        assert(freq_size == kHistogramSymbols);
+        ZIPLAB_UNUSED(freq_size);
+
+        count_histogram(input_data.data(), input_data.size(), freqs);
+    }
+
+    void build_table(const SymbolStats & stats) {
+        std::vector<std::uint8_t> spread(kTableSize);
+        tans_spread_symbols(stats, static_cast<std::uint32_t>(kTableLog), spread.data());
+
+        // The k-th occurrence of the symbol s in the spread order is the state
+        // (kTableSize + position), it's stored at state_table_[cumul + k].
+        std::uint32_t next_index[kSymbolTotal];
+        for (size_type symbol = 0; symbol < kSymbolTotal; symbol++) {
+            next_index[symbol] = stats.symbols[symbol].cumul;
+        }
+        for (std::uint32_t position = 0; position < kTableSize; position++) {
+            Symbol symbol = spread[position];
+            state_table_[next_index[symbol]++] = static_cast<std::uint16_t>(kTableSize + position);
+        }
+
+        for (size_type symbol = stats.min_symbol; symbol <= stats.max_symbol; symbol++) {
+            std::uint32_t freq = stats.symbols[symbol].freq;
+            std::uint32_t cumul = stats.symbols[symbol].cumul;
+            SymbolTransform & tt = symbol_tt_[symbol];
+            if (freq == 1) {
+                tt.delta_nbbits = static_cast<std::uint32_t>(kTableLog << 16) - kTableSize;
+                tt.delta_find_state = static_cast<std::int32_t>(cumul) - 1;
+            } else if (freq != 0) {
+                // The state keeps max_bits_out or (max_bits_out - 1) bits
+                std::uint32_t max_bits_out = static_cast<std::uint32_t>(kTableLog) - tans_highbit(freq - 1);
+                std::uint32_t min_state_plus = freq << max_bits_out;
+                tt.delta_nbbits = (max_bits_out << 16) - min_state_plus;
+                tt.delta_find_state = static_cast<std::int32_t>(cumul) - static_cast<std::int32_t>(freq);
+            }
+        }
+    }
+
+    void write_symbol_stats(const SymbolStats & stats, OutputStream & output_os) {
+        // Write symbol range: [min_symbol, max_symbol]
+        output_os.writeUInt8(stats.min_symbol);
+        output_os.writeUInt8(stats.max_symbol);
+
+        // Write symbol scaled frequencies, 7 bits per byte, low bits first
+        for (size_type symbol = stats.min_symbol; symbol <= stats.max_symbol; symbol++) {
+            std::uint32_t freq = stats.symbols[symbol].freq;
+            while (freq >= 0x80u) {
+                output_os.writeUInt8(static_cast<std::uint8_t>(freq | 0x80u));
+                freq >>= 7;
+            }
+            output_os.writeUInt8(static_cast<std::uint8_t>(freq));
+        }
+    }
+
+public:
+    ZIPLAB_FORCED_INLINE
+    state_type encode(state_type state, Symbol symbol, BitWriter & writer) {
+        const SymbolTransform & tt = symbol_tt_[symbol];
+        std::uint32_t nbits = (state + tt.delta_nbbits) >> 16;
+        if (nbits != 0) {
+            writer.put(state & ((1u << nbits) - 1), nbits);
+        }
+        return state_table_[static_cast<std::int32_t>(state >> nbits) + tt.delta_find_state];
+    }
+
+    int compress(const std::string & input_data, MemoryBuffer & compressed_data) {
+        int err_code = 0;
+        OutputStream output_os(compressed_data);
+
+        size_type data_size = input_data.size();
+        if (ziplab_likely(data_size != 0)) {
+            std::uint32_t freqs[kSymbolTotal];
+            count_freq(input_data, freqs, kSymbolTotal);
+
+            SymbolStats stats(kSymbolTotal);
+            if (!normalize_symbol_stats(stats, freqs, kSymbolTotal, kTableSize))
+                return -1;
+
+            write_symbol_stats(stats, output_os);
+            build_table(stats);
+
+            // Write the content size
+            output_os.writeUInt32(static_cast<std::uint32_t>(data_size));
+            // Write the bit count, fill it after encoding
+            size_type bit_count_pos = compressed_data.size();
+            output_os.writeUInt32(0);
+
+            size_type bits_start = compressed_data.size();
+            compressed_data.reserve(bits_start + data_size + sizeof(BitWriter::bitbuf_type));
+
+            // Start encode, in reverse order, the symbol i uses the state (i % NumStates)
+            const Symbol * data = reinterpret_cast<const Symbol *>(input_data.data());
+            BitWriter writer(compressed_data);
+            state_type states[NumStates];
+            for (size_type n = 0; n < NumStates; n++) {
+                states[n] = kTableSize;
+            }
+
+            size_type puts = 0;
+            for (size_type i = data_size; i > 0; i--) {
+                state_type & state = states[(i - 1) % NumStates];
+                state = encode(state, data[i - 1], writer);
+                if (++puts == kPutsPerFlush) {
+                    writer.flush();
+                    puts = 0;
+                }
+            }
+
+            // The final states, the decoder reads them first
+            for (size_type n = 0; n < NumStates; n++) {
+                writer.flush();
+                writer.put(states[n] - kTableSize, kTableLog);
+            }
+
+            size_type bit_count = (compressed_data.size() - bits_start) * 8 + writer.bitcount();
+            writer.finish();
+            if (bit_count > 0xFFFFFFFFu)
+                return -1;
+
+            std::uint32_t bit_count32 = static_cast<std::uint32_t>(bit_count);
+            std::memcpy(compressed_data.data() + bit_count_pos, &bit_count32, sizeof(bit_count32));
+        }
+
+        return err_code;
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_RANS_TANSENCODER_HPP
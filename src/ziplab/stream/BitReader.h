@@ -0,0 +1,124 @@
+#ifndef ZIPLAB_STREAM_BITREADER_HPP
+#define ZIPLAB_STREAM_BITREADER_HPP
+
+#pragma once
+
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>      // For std::memcpy()
+
+#include "ziplab/basic/stddef.h"
+
+#if defined(_MSC_VER)
+#include <stdlib.h>     // For _byteswap_uint64()
+#endif
+
+namespace ziplab {
+
+//
+// MSB-first bit reader with a 64-bit left-aligned bit buffer.
+//
+// The first bit of the stream is the highest bit of the first byte,
+// which is the same bit order as the Huffman encoder produces.
+//
+// refill() guarantees at least kMinRefillBits valid bits in the bit buffer,
+// so the caller can peek and consume several short codes per refill.
+// Past the end of the input, the bit buffer is padded with zero bits.
+//
+class BitReader
+{
+public:
+    using size_type   = std::size_t;
+    using bitbuf_type = std::uint64_t;
+
+    static constexpr size_type kBitBufBits = sizeof(bitbuf_type) * 8;
+    static constexpr size_type kMinRefillBits = kBitBufBits - 8;
+
+private:
+    const std::uint8_t * cur_;
+    const std::uint8_t * end_;
+    bitbuf_type          bitbuf_;
+    size_type            bitcount_;
+    size_type            overrun_;
+
+public:
+    BitReader(const void * data, size_type size)
+        : cur_(static_cast<const std::uint8_t *>(data)),
+          end_(static_cast<const std::uint8_t *>(data) + size),
+          bitbuf_(0), bitcount_(0), overrun_(0) {
+    }
+
+    ~BitReader() {
+        //
+    }
+
+    size_type bitcount() const { return bitcount_; }
+
+    // Whether the consumed bits have run past the end of input.
+    bool is_overflow() const { return ((overrun_ * 8) > bitcount_); }
+
+    // Ensure that there are at least kMinRefillBits valid bits in the bit buffer.
+    ZIPLAB_FORCED_INLINE
+    void refill() {
+        if (ziplab_likely((end_ - cur_) >= 8)) {
+            bitbuf_ |= load_be64(cur_) >> bitcount_;
+            cur_ += ((kBitBufBits - 1) - bitcount_) >> 3;
+            bitcount_ |= kMinRefillBits;
+        } else {
+            refill_tail();
+        }
+    }
+
+    ZIPLAB_FORCED_INLINE
+    bitbuf_type peek(size_type nbits) const {
+        assert(nbits > 0 && nbits <= kMinRefillBits);
+        return (bitbuf_ >> (kBitBufBits - nbits));
+    }
+
+    ZIPLAB_FORCED_INLINE
+    void consume(size_type nbits) {
+        assert(nbits <= bitcount_);
+        bitbuf_ <<= nbits;
+        bitcount_ -= nbits;
+    }
+
+    ZIPLAB_FORCED_INLINE
+    bitbuf_type read(size_type nbits) {
+        bitbuf_type value = peek(nbits);
+        consume(nbits);
+        return value;
+    }
+
+private:
+    static inline bitbuf_type load_be64(const std::uint8_t * ptr) {
+        bitbuf_type value;
+        std::memcpy(&value, ptr, sizeof(value));
+#if (ZIPLAB_ENDIAN == ZIPLAB_LITTLE_ENDIAN)
+  #if defined(_MSC_VER)
+        value = _byteswap_uint64(value);
+  #else
+        value = __builtin_bswap64(value);
+  #endif
+#endif
+        return value;
+    }
+
+    ZIPLAB_NO_INLINE
+    void refill_tail() {
+        while (bitcount_ <= kMinRefillBits) {
+            if (cur_ < end_) {
+                bitbuf_ |= static_cast<bitbuf_type>(*cur_++) << (kBitBufBits - 8 - bitcount_);
+            } else {
+                // Pad with zero bits
+                overrun_++;
+            }
+            bitcount_ += 8;
+        }
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_STREAM_BITREADER_HPP
@@ -0,0 +1,103 @@
+#ifndef ZIPLAB_STREAM_BITWRITER_HPP
+#define ZIPLAB_STREAM_BITWRITER_HPP
+
+#pragma once
+
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>      // For std::memcpy()
+
+#include "ziplab/basic/stddef.h"
+#include "ziplab/stream/MemoryBuffer.h"
+
+#if defined(_MSC_VER)
+#include <stdlib.h>     // For _byteswap_uint64()
+#endif
+
+namespace ziplab {
+
+//
+// MSB-first bit writer with a 64-bit left-aligned bit buffer,
+// it's the counterpart of BitReader.
+//
+// put() only appends the code to the bit buffer, flush() stores the whole
+// 64-bit word to the output buffer and advances the output by the complete
+// bytes, so after a flush() there are at most 7 bits left in the bit buffer.
+// The caller must keep (bitcount() + length) < 64 for each put(), e.g.
+// four 14-bit codes or three 18-bit codes can be put between two flush().
+//
+class BitWriter
+{
+public:
+    using size_type   = std::size_t;
+    using bitbuf_type = std::uint64_t;
+
+    static constexpr size_type kBitBufBits = sizeof(bitbuf_type) * 8;
+
+    // The number of bits that can be put after a flush().
+    static constexpr size_type kMaxPutBits = kBitBufBits - 8;
+
+private:
+    MemoryBuffer & buffer_;
+    bitbuf_type    bitbuf_;
+    size_type      bitcount_;
+
+public:
+    BitWriter(MemoryBuffer & buffer)
+        : buffer_(buffer), bitbuf_(0), bitcount_(0) {
+    }
+
+    ~BitWriter() {
+        //
+    }
+
+    size_type bitcount() const { return bitcount_; }
+
+    ZIPLAB_FORCED_INLINE
+    void put(bitbuf_type code, size_type length) {
+        assert(length > 0);
+        assert((bitcount_ + length) < kBitBufBits);
+        assert((code >> length) == 0);
+        bitcount_ += length;
+        bitbuf_ |= code << (kBitBufBits - bitcount_);
+    }
+
+    ZIPLAB_FORCED_INLINE
+    void flush() {
+        buffer_.grow(sizeof(bitbuf_type));
+        store_be64(buffer_.current(), bitbuf_);
+
+        size_type flush_bytes = bitcount_ >> 3;
+        buffer_.forward(flush_bytes);
+        bitbuf_ <<= (flush_bytes << 3);
+        bitcount_ &= 7;
+    }
+
+    // Write the remaining bits, the last byte is padded with zero bits.
+    void finish() {
+        buffer_.grow(sizeof(bitbuf_type));
+        store_be64(buffer_.current(), bitbuf_);
+
+        buffer_.forward((bitcount_ + 7) >> 3);
+        bitbuf_ = 0;
+        bitcount_ = 0;
+    }
+
+private:
+    static inline void store_be64(char * ptr, bitbuf_type value) {
+#if (ZIPLAB_ENDIAN == ZIPLAB_LITTLE_ENDIAN)
+  #if defined(_MSC_VER)
+        value = _byteswap_uint64(value);
+  #else
+        value = __builtin_bswap64(value);
+  #endif
+#endif
+        std::memcpy(ptr, &value, sizeof(value));
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_STREAM_BITWRITER_HPP
@@ -116,6 +116,15 @@ public:
         }
     }
 
+    // Read at most [size] bytes from the current position, return the bytes read.
+    size_type read(char_type * buffer, size_type size) {
+        if (ifs_.good()) {
+            ifs_.read(buffer, static_cast<std::streamsize>(size));
+            return static_cast<size_type>(ifs_.gcount());
+        }
+        return 0;
+    }
+
     size_type readFile(std::string & content, size_type readBuffSize = 0) {
         size_type totolReadBytes = 0;
 
@@ -118,6 +118,17 @@ public:
         }
     }
 
+    // Write [size] bytes at the current position, return the bytes written.
+    size_type write(const char_type * data, size_type size) {
+        if (ofs_.good()) {
+            ofs_.write(data, static_cast<std::streamsize>(size));
+            if (ofs_.good()) {
+                return size;
+            }
+        }
+        return 0;
+    }
+
     size_type writeFile(std::string & content, size_type writeBuffSize = 0) {
         size_type totolWriteBytes = 0;
 
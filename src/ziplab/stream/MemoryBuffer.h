@@ -221,7 +221,7 @@ public:
         if (ziplab_likely(new_size <= this->capacity())) {
             return;
         } else {
-            grow_impl(new_size);
+            grow_impl(delta_size);
         }
     }
 
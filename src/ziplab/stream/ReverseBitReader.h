@@ -0,0 +1,108 @@
+#ifndef ZIPLAB_STREAM_REVERSEBITREADER_HPP
+#define ZIPLAB_STREAM_REVERSEBITREADER_HPP
+
+#pragma once
+
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>      // For std::memcpy()
+
+#include "ziplab/basic/stddef.h"
+
+#if defined(_MSC_VER)
+#include <stdlib.h>     // For _byteswap_uint64()
+#endif
+
+namespace ziplab {
+
+//
+// Reads a BitWriter stream backward: each read() returns the last code
+// which hasn't been read yet, it's the reader of the LIFO entropy coders
+// (e.g. tANS), which encode in the reverse order of decoding.
+//
+// bitcount is the exact number of bits written, without the zero bits
+// padding the last byte.
+//
+class ReverseBitReader
+{
+public:
+    using size_type   = std::size_t;
+    using bitbuf_type = std::uint64_t;
+
+    static constexpr size_type kBitBufBits = sizeof(bitbuf_type) * 8;
+
+    // The max number of bits of one read().
+    static constexpr size_type kMaxReadBits = kBitBufBits - 8;
+
+private:
+    const std::uint8_t * data_;
+    size_type            size_;
+    size_type            bitpos_;
+    bool                 overflow_;
+
+public:
+    ReverseBitReader(const void * data, size_type size, size_type bitcount)
+        : data_(static_cast<const std::uint8_t *>(data)), size_(size),
+          bitpos_(bitcount), overflow_(false) {
+        assert(bitcount <= size * 8);
+    }
+
+    ~ReverseBitReader() {
+        //
+    }
+
+    // The number of bits which haven't been read.
+    size_type bitpos() const { return bitpos_; }
+
+    // Whether a read() has run past the beginning of the stream.
+    bool is_overflow() const { return overflow_; }
+
+    ZIPLAB_FORCED_INLINE
+    bitbuf_type read(size_type nbits) {
+        assert(nbits <= kMaxReadBits);
+        if (ziplab_unlikely(nbits > bitpos_)) {
+            overflow_ = true;
+            bitpos_ = 0;
+            return 0;
+        }
+
+        bitpos_ -= nbits;
+        size_type byte_pos = bitpos_ >> 3;
+        bitbuf_type bitbuf;
+        if (ziplab_likely((byte_pos + sizeof(bitbuf_type)) <= size_))
+            bitbuf = load_be64(data_ + byte_pos);
+        else
+            bitbuf = load_be64_tail(byte_pos);
+
+        // Shift twice, so that nbits = 0 doesn't shift by 64
+        return (((bitbuf << (bitpos_ & 7)) >> (kBitBufBits - 1 - nbits)) >> 1);
+    }
+
+private:
+    static inline bitbuf_type load_be64(const std::uint8_t * ptr) {
+        bitbuf_type value;
+        std::memcpy(&value, ptr, sizeof(value));
+#if (ZIPLAB_ENDIAN == ZIPLAB_LITTLE_ENDIAN)
+  #if defined(_MSC_VER)
+        value = _byteswap_uint64(value);
+  #else
+        value = __builtin_bswap64(value);
+  #endif
+#endif
+        return value;
+    }
+
+    // The last bytes of the stream, padded with zero bytes.
+    ZIPLAB_NO_INLINE
+    bitbuf_type load_be64_tail(size_type byte_pos) const {
+        std::uint8_t bytes[sizeof(bitbuf_type)] = { 0 };
+        std::memcpy(bytes, data_ + byte_pos, size_ - byte_pos);
+        return load_be64(bytes);
+    }
+};
+
+} // namespace ziplab
+
+#endif // ZIPLAB_STREAM_REVERSEBITREADER_HPP
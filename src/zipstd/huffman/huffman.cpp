@@ -6,126 +6,320 @@
 #include <sstream>
 #include <string>
 #include <vector>
-#include <queue>
-#include <bitset>
 #include <algorithm>
 
 #include <assert.h>
 
 #include <ziplab/basic/stddef.h>
+#include <ziplab/entropy/Histogram.h>
 
 namespace zipstd {
 
+void HuffmanCompressor::buildHistogram(const HuffmanByte * data, std::size_t size, Histogram & histogram)
+{
+    static_assert(kMaxSymbols == ziplab::kHistogramSymbols,
+                  "kMaxSymbols must be equal to kHistogramSymbols");
+    ziplab::count_histogram(data, size, histogram.data());
+}
+
+//
+// Sort the used symbols by frequency with LSD radix sort, 8 bits per pass,
+// the passes of the high bytes that are all zero are skipped. The sort is stable,
+// so the symbols of the same frequency are kept in ascending order.
+//
+static std::size_t sortSymbolsByFreq(const HuffmanCompressor::Histogram & histogram, std::uint8_t * symbols)
+{
+    std::size_t num_symbols = 0;
+    std::uint32_t all_freqs = 0;
+    for (std::size_t symbol = 0; symbol < HuffmanCompressor::kMaxSymbols; symbol++) {
+        std::uint32_t freq = histogram[symbol];
+        if (freq != 0) {
+            symbols[num_symbols++] = static_cast<std::uint8_t>(symbol);
+            all_freqs |= freq;
+        }
+    }
+
+    std::uint8_t buffer[HuffmanCompressor::kMaxSymbols];
+    std::uint8_t * src = symbols;
+    std::uint8_t * dest = buffer;
+    for (std::size_t shift = 0; shift < 32 && (all_freqs >> shift) != 0; shift += 8) {
+        std::uint32_t offsets[256 + 1] = { 0 };
+        for (std::size_t i = 0; i < num_symbols; i++) {
+            offsets[((histogram[src[i]] >> shift) & 0xFF) + 1]++;
+        }
+        for (std::size_t digit = 0; digit < 256; digit++) {
+            offsets[digit + 1] += offsets[digit];
+        }
+        for (std::size_t i = 0; i < num_symbols; i++) {
+            dest[offsets[(histogram[src[i]] >> shift) & 0xFF]++] = src[i];
+        }
+        std::swap(src, dest);
+    }
+
+    if (src != symbols) {
+        std::copy(src, src + num_symbols, symbols);
+    }
+    return num_symbols;
+}
+
 HuffmanNode *
-HuffmanCompressor::buildHuffmanTree(const FreqMap & freqMap)
+HuffmanCompressor::buildHuffmanTree(const Histogram & histogram)
 {
-    // Create priority queue
-    HuffmanCompare comp;
-    std::priority_queue<HuffmanNode *,
-                        std::vector<HuffmanNode *>,
-                        decltype(comp)> pq(comp);
-
-    // Add all characters to queue
-    for (const auto & iter : freqMap) {
-        pq.push(new HuffmanNode(iter.first, iter.second));
+    // All the nodes of the previous tree are released
+    node_count_ = 0;
+
+    std::uint8_t symbols[kMaxSymbols];
+    std::size_t num_leaves = sortSymbolsByFreq(histogram, symbols);
+    if (num_leaves == 0) return nullptr;
+
+    // The first queue: the leaves sorted by frequency
+    for (std::size_t i = 0; i < num_leaves; i++) {
+        newNode(symbols[i], histogram[symbols[i]]);
     }
 
-    // Build Huffman tree
-    while (pq.size() >= 2) {
-        auto left = pq.top(); pq.pop();
-        auto right = pq.top(); pq.pop();
+    //
+    // The second queue: the internal nodes, they are created in non-decreasing
+    // order of frequency, so the two smallest nodes are always at the front of
+    // the two queues.
+    //
+    HuffmanNode * nodes = node_pool_.data();
+    std::size_t leaf = 0;
+    std::size_t internal = num_leaves;
+    for (std::size_t n = 1; n < num_leaves; n++) {
+        HuffmanNode * children[2];
+        for (std::size_t k = 0; k < 2; k++) {
+            if ((leaf < num_leaves) &&
+                ((internal >= node_count_) || (nodes[leaf].freq <= nodes[internal].freq)))
+                children[k] = &nodes[leaf++];
+            else
+                children[k] = &nodes[internal++];
+        }
 
-        auto parent = new HuffmanNode('\0', left->freq + right->freq);
-        parent->left = left;
-        parent->right = right;
-        pq.push(parent);
+        auto parent = newNode('\0', children[0]->freq + children[1]->freq);
+        parent->left = children[0];
+        parent->right = children[1];
     }
 
-    return (pq.empty() ? nullptr : pq.top());
+    return &nodes[node_count_ - 1];
 }
 
 HuffmanNode *
 HuffmanCompressor::buildHuffmanTree(const std::vector<HuffmanByte> & data)
 {
     // Calculate frequencies
-    FreqMap freqMap;
-    for (HuffmanByte c : data) {
-        freqMap[c]++;
-    }
+    Histogram histogram;
+    buildHistogram(data.data(), data.size(), histogram);
 
-    return buildHuffmanTree(freqMap);
+    return buildHuffmanTree(histogram);
 }
 
-void HuffmanCompressor::generateHuffmanCodes(HuffmanNode * node,
-                                             const std::string & code,
-                                             CodeMap & codes)
+std::size_t HuffmanCompressor::generateCodeLengths(HuffmanNode * node, std::size_t depth,
+                                                   CodeLengths & lengths)
 {
     assert(node != nullptr);
     if (ziplab_likely(!isLeaf(node))) {
         // Internal node
         assert(node->left != nullptr);
-        generateHuffmanCodes(node->left,  code + "0", codes);
-        
+        std::size_t left_length = generateCodeLengths(node->left, depth + 1, lengths);
+
         assert(node->right != nullptr);
-        generateHuffmanCodes(node->right, code + "1", codes);
+        std::size_t right_length = generateCodeLengths(node->right, depth + 1, lengths);
+        return (std::max)(left_length, right_length);
     } else {
-        // Leaf node
-        codes[node->data] = code;
+        // Leaf node, a lone symbol also uses a 1 bit code
+        std::size_t length = (depth > 0) ? depth : 1;
+        lengths[node->data] = static_cast<std::uint8_t>(length);
+        return length;
     }
 }
 
-std::vector<HuffmanByte>
-HuffmanCompressor::serializeTree(HuffmanNode * node)
+void HuffmanCompressor::buildCodeLengths(HuffmanNode * root, CodeLengths & lengths)
 {
-    std::vector<HuffmanByte> result;
-    assert(node != nullptr);
+    lengths.fill(0);
+    std::size_t max_length = generateCodeLengths(root, 0, lengths);
 
-    // Use preorder traversal to serialize the tree
-    if (ziplab_likely(!isLeaf(node))) {
-        result.push_back(0);  // Internal node marker
-        assert(node->left != nullptr);
-        auto left_ser  = serializeTree(node->left);
-        assert(node->right != nullptr);
-        auto right_ser = serializeTree(node->right);
-        result.insert(result.end(), left_ser.begin(),  left_ser.end());
-        result.insert(result.end(), right_ser.begin(), right_ser.end());
-    } else {
-        result.push_back(1);  // Leaf node marker
-        result.push_back(node->data);
+    if (ziplab_unlikely(max_length > max_code_length_)) {
+        // The codes are too long, rebuild the code lengths with the length limit.
+        std::size_t num_leaves = (node_count_ + 1) / 2;
+        buildLimitedCodeLengths(node_pool_.data(), num_leaves, max_code_length_, lengths);
+    }
+}
+
+//
+// Package-merge algorithm (Larmore and Hirschberg).
+//
+// lists[0] is the leaves sorted by frequency, lists[i] is the leaves merged with
+// the packages of each two adjacent items in lists[i - 1]. Select the first 2n - 2
+// items of the last list, then the first (2 * packages) items of the previous list,
+// and so on. The code length of a symbol is the number of times its leaf is selected.
+//
+void HuffmanCompressor::buildLimitedCodeLengths(const HuffmanNode * leaves, std::size_t num_leaves,
+                                                std::size_t max_length, CodeLengths & lengths)
+{
+    struct PackageItem {
+        std::uint64_t weight;
+        std::int32_t  symbol;   // -1 is a package of two items in the previous list
+    };
+
+    // The leaves are sorted by frequency
+    std::vector<PackageItem> items(num_leaves);
+    for (std::size_t i = 0; i < num_leaves; i++) {
+        items[i].weight = leaves[i].freq;
+        items[i].symbol = static_cast<std::int32_t>(leaves[i].data);
+    }
+
+    lengths.fill(0);
+
+    if (num_leaves <= 2) {
+        for (const auto & item : items) {
+            lengths[item.symbol] = 1;
+        }
+        return;
+    }
+    assert(max_length <= kMaxCodeLength);
+    assert((static_cast<std::uint64_t>(1) << max_length) >= num_leaves);
+
+    std::vector<std::vector<PackageItem>> lists(max_length);
+    lists[0] = items;
+    for (std::size_t level = 1; level < max_length; level++) {
+        const std::vector<PackageItem> & prev = lists[level - 1];
+        std::vector<PackageItem> & list = lists[level];
+        std::size_t num_packages = prev.size() / 2;
+        list.reserve(num_leaves + num_packages);
+
+        std::size_t i = 0, j = 0;
+        while (i < num_leaves || j < num_packages) {
+            if (j < num_packages) {
+                std::uint64_t weight = prev[j * 2].weight + prev[j * 2 + 1].weight;
+                if (i >= num_leaves || weight < items[i].weight) {
+                    list.push_back({ weight, -1 });
+                    j++;
+                    continue;
+                }
+            }
+            list.push_back(items[i++]);
+        }
     }
 
-    return result;
+    std::size_t num_items = num_leaves * 2 - 2;
+    for (std::size_t level = max_length; level-- > 0; ) {
+        const std::vector<PackageItem> & list = lists[level];
+        assert(num_items <= list.size());
+        std::size_t num_packages = 0;
+        for (std::size_t i = 0; i < num_items; i++) {
+            if (list[i].symbol >= 0)
+                lengths[list[i].symbol]++;
+            else
+                num_packages++;
+        }
+        num_items = num_packages * 2;
+    }
 }
 
-HuffmanNode *
-HuffmanCompressor::deserializeTree(const std::vector<HuffmanByte> & tree_data, std::size_t & index) {
-    if (index >= tree_data.size()) {
-        return nullptr;
+void HuffmanCompressor::assignCanonicalCodes(const CodeLengths & lengths, CodeTable & codes)
+{
+    // Count the number of codes for each code length
+    std::uint32_t length_count[kMaxCodeLength + 1] = { 0 };
+    for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+        assert(lengths[symbol] <= kMaxCodeLength);
+        length_count[lengths[symbol]]++;
+    }
+    length_count[0] = 0;
+
+    // The first code of each code length
+    std::uint64_t next_code[kMaxCodeLength + 1];
+    std::uint64_t code = 0;
+    next_code[0] = 0;
+    for (std::size_t length = 1; length <= kMaxCodeLength; length++) {
+        code = (code + length_count[length - 1]) << 1;
+        next_code[length] = code;
     }
 
-    if (ziplab_likely(tree_data[index] == 0)) {  // Internal node
-        index++;
-        assert(index < tree_data.size());
+    // Assign codes in the order of symbols for each code length
+    for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+        std::size_t length = lengths[symbol];
+        if (length != 0) {
+            codes[symbol].code = static_cast<std::uint32_t>(next_code[length]++);
+            codes[symbol].length = static_cast<std::uint32_t>(length);
+        } else {
+            codes[symbol].code = 0;
+            codes[symbol].length = 0;
+        }
+    }
+}
 
-        auto node = new HuffmanNode('\0', 0);
+//
+// The code lengths header, it's the same as ziplab::HuffmanCompressor:
+//
+// [min_symbol: 1 byte][max_symbol: 1 byte][max_length: 1 byte]
+// [the code lengths of symbols in range [min_symbol, max_symbol]]
+//
+// The code lengths are packed into 4 bits (low nibble first) if max_length <= 15,
+// otherwise each code length uses 1 byte.
+//
+void HuffmanCompressor::writeCodeLengths(const CodeLengths & lengths, std::vector<HuffmanByte> & output)
+{
+    std::size_t min_symbol = kMaxSymbols;
+    std::size_t max_symbol = 0;
+    std::size_t max_length = 0;
+    for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+        std::size_t length = lengths[symbol];
+        if (length != 0) {
+            if (symbol < min_symbol)
+                min_symbol = symbol;
+            max_symbol = symbol;
+            if (length > max_length)
+                max_length = length;
+        }
+    }
+    assert(min_symbol <= max_symbol);
 
-        node->left  = deserializeTree(tree_data, index);
-        assert(node->left != nullptr);
-        assert(index < tree_data.size());
+    output.push_back(static_cast<HuffmanByte>(min_symbol));
+    output.push_back(static_cast<HuffmanByte>(max_symbol));
+    output.push_back(static_cast<HuffmanByte>(max_length));
 
-        node->right = deserializeTree(tree_data, index);
-        assert(node->right != nullptr);
-        assert(index <= tree_data.size());
+    if (max_length <= 15) {
+        for (std::size_t symbol = min_symbol; symbol <= max_symbol; symbol += 2) {
+            std::uint8_t low  = lengths[symbol];
+            std::uint8_t high = (symbol < max_symbol) ? lengths[symbol + 1] : 0;
+            output.push_back(static_cast<HuffmanByte>(low | (high << 4)));
+        }
+    } else {
+        output.insert(output.end(), lengths.begin() + min_symbol, lengths.begin() + max_symbol + 1);
+    }
+}
 
-        return node;
-    } else {  // Leaf node
-        index++;
-        assert(index < tree_data.size());
+std::size_t HuffmanCompressor::readCodeLengths(const std::vector<HuffmanByte> & input, std::size_t & pos,
+                                               CodeLengths & lengths)
+{
+    if ((pos + 3) > input.size()) return 0;
 
-        auto node = new HuffmanNode(tree_data[index], 0);
-        index++;
-        return node;
+    std::size_t min_symbol = input[pos++];
+    std::size_t max_symbol = input[pos++];
+    std::size_t max_length = input[pos++];
+    if ((min_symbol > max_symbol) || (max_length == 0) || (max_length > kMaxCodeLength)) {
+        return 0;
     }
+
+    std::size_t num_symbols = max_symbol - min_symbol + 1;
+    std::size_t header_size = (max_length <= 15) ? ((num_symbols + 1) / 2) : num_symbols;
+    if ((pos + header_size) > input.size()) return 0;
+
+    lengths.fill(0);
+    for (std::size_t i = 0; i < num_symbols; i++) {
+        std::uint8_t length;
+        if (max_length <= 15) {
+            HuffmanByte packed = input[pos + i / 2];
+            length = static_cast<std::uint8_t>((i & 1) ? (packed >> 4) : (packed & 0x0F));
+        } else {
+            length = input[pos + i];
+        }
+        if (length > max_length) return 0;
+        lengths[min_symbol + i] = length;
+    }
+    pos += header_size;
+
+    return max_length;
 }
 
 std::vector<HuffmanByte>
@@ -137,48 +331,44 @@ HuffmanCompressor::compress(const std::vector<HuffmanByte> & data)
         auto root = buildHuffmanTree(data);
         assert(root != nullptr);
 
-        // Generate encoding table
-        CodeMap codes;
-        generateHuffmanCodes(root, "", codes);
-
-        // Serialize tree structure
-        auto tree_data = serializeTree(root);
+        // Generate canonical codes
+        CodeLengths lengths;
+        buildCodeLengths(root, lengths);
 
-        // Compress data
-        std::string bits;
-
-        // Add tree size
-        std::size_t tree_size = tree_data.size();
-        for (std::size_t i = 0; i < sizeof(std::size_t); ++i) {
-            compressed.push_back(static_cast<HuffmanByte>((tree_size >> (i * 8)) & 0xFF));
-        }
+        CodeTable codes;
+        assignCanonicalCodes(lengths, codes);
 
         // Add original data size
-        std::size_t data_size = data.size();
-        for (std::size_t i = 0; i < sizeof(std::size_t); ++i) {
+        assert(data.size() <= kMaxDataSize);
+        std::uint32_t data_size = static_cast<std::uint32_t>(data.size());
+        for (std::size_t i = 0; i < sizeof(std::uint32_t); ++i) {
             compressed.push_back(static_cast<HuffmanByte>((data_size >> (i * 8)) & 0xFF));
         }
 
-        // Add tree data
-        compressed.insert(compressed.end(), tree_data.begin(), tree_data.end());
+        // Add code lengths
+        writeCodeLengths(lengths, compressed);
+
+        // A lone symbol doesn't need the data body
+        if (ziplab_unlikely(isLeaf(root))) {
+            return compressed;
+        }
 
         // Compress data body
+        std::uint64_t bitbuf = 0;
+        std::size_t bitcount = 0;
         for (HuffmanByte c : data) {
-            bits += codes[c];
-            while (bits.length() >= 8) {
-                std::bitset<8> byte(bits.substr(0, 8));
-                compressed.push_back(static_cast<HuffmanByte>(byte.to_ulong()));
-                bits = bits.substr(8);
+            const HuffmanCode & hcode = codes[c];
+            bitbuf = (bitbuf << hcode.length) | hcode.code;
+            bitcount += hcode.length;
+            while (bitcount >= 8) {
+                bitcount -= 8;
+                compressed.push_back(static_cast<HuffmanByte>(bitbuf >> bitcount));
             }
         }
 
         // Handle remaining bits
-        if (!bits.empty()) {
-            while (bits.length() < 8) {
-                bits += '0';
-            }
-            std::bitset<8> byte(bits);
-            compressed.push_back(static_cast<HuffmanByte>(byte.to_ulong()));
+        if (bitcount > 0) {
+            compressed.push_back(static_cast<HuffmanByte>(bitbuf << (8 - bitcount)));
         }
     }
     return compressed;
@@ -188,153 +378,189 @@ std::vector<HuffmanByte>
 HuffmanCompressor::decompress(const std::vector<HuffmanByte> & compressed_data)
 {
     std::vector<HuffmanByte> decompressed;
-    if (ziplab_likely(compressed_data.size() >= sizeof(std::size_t) * 2)) {
+    if (ziplab_likely(compressed_data.size() >= sizeof(std::uint32_t))) {
         std::size_t pos = 0;
 
-        // Read tree size
-        std::size_t tree_size = 0;
-        for (std::size_t i = 0; i < sizeof(std::size_t); ++i) {
-            tree_size |= static_cast<std::size_t>(compressed_data[pos++]) << (i * 8);
-        }
-
         // Read original data size
         std::size_t data_size = 0;
-        for (std::size_t i = 0; i < sizeof(std::size_t); ++i) {
+        for (std::size_t i = 0; i < sizeof(std::uint32_t); ++i) {
             data_size |= static_cast<std::size_t>(compressed_data[pos++]) << (i * 8);
         }
 
-        // Read and rebuild tree
-        std::vector<HuffmanByte> tree_data(compressed_data.begin() + pos,
-                                           compressed_data.begin() + pos + tree_size);
-        size_t tree_index = 0;
-        auto root = deserializeTree(tree_data, tree_index);
-        pos += tree_size;
+        // Read code lengths
+        CodeLengths lengths;
+        std::size_t max_length = readCodeLengths(compressed_data, pos, lengths);
+        if (max_length == 0) return decompressed;
+
+        //
+        // Canonical decoding tables: the number of codes for each code length,
+        // and the symbols sorted by (code length, symbol).
+        //
+        std::uint32_t length_count[kMaxCodeLength + 1] = { 0 };
+        HuffmanByte symbols[kMaxSymbols];
+        std::size_t num_symbols = 0;
+        for (std::size_t length = 1; length <= max_length; length++) {
+            for (std::size_t symbol = 0; symbol < kMaxSymbols; symbol++) {
+                if (lengths[symbol] == length) {
+                    length_count[length]++;
+                    symbols[num_symbols++] = static_cast<HuffmanByte>(symbol);
+                }
+            }
+        }
 
-        // Decompress data
-        auto current = root;
-        std::string bits;
+        // A lone symbol, there is no data body, its size is bounded by the 32-bit field only
+        if (ziplab_unlikely(num_symbols == 1)) {
+            decompressed.assign(data_size, symbols[0]);
+            return decompressed;
+        }
 
-        while (decompressed.size() < data_size && pos < compressed_data.size()) {
-            std::bitset<8> byte(compressed_data[pos++]);
-            bits += byte.to_string();
+        // Each symbol takes min_length bits of the data body at least,
+        // reject the data size that the body can't hold before allocating.
+        std::size_t min_length = 1;
+        while (length_count[min_length] == 0)
+            min_length++;
+        if (data_size > (compressed_data.size() - pos) * 8 / min_length)
+            return decompressed;
 
-            while (!bits.empty() && (decompressed.size() < data_size)) {
-                if (current == nullptr)
-                    current = root;
+        decompressed.reserve(data_size);
 
-                if (bits[0] == '0') {
-                    current = current->left;
-                } else {
-                    current = current->right;
-                }
+        // Decompress data, one bit at a time
+        std::uint32_t code = 0;     // The bits read so far
+        std::uint32_t first = 0;    // The first code of current length
+        std::size_t index = 0;      // The index of the first code of current length in symbols[]
+        std::size_t length = 1;
 
-                if ((current != nullptr) && isLeaf(current)) {
-                    decompressed.push_back(current->data);
-                    current = root;
+        while (decompressed.size() < data_size && pos < compressed_data.size()) {
+            HuffmanByte byte = compressed_data[pos++];
+            for (int bit = 7; bit >= 0 && decompressed.size() < data_size; bit--) {
+                code |= (byte >> bit) & 1U;
+                std::uint32_t count = length_count[length];
+                if ((code - first) < count) {
+                    decompressed.push_back(symbols[index + (code - first)]);
+                    code = 0;
+                    first = 0;
+                    index = 0;
+                    length = 1;
+                } else {
+                    index += count;
+                    first = (first + count) << 1;
+                    code <<= 1;
+                    length++;
+                    if (ziplab_unlikely(length > max_length)) {
+                        // Invalid code
+                        return {};
+                    }
                 }
-
-                bits = bits.substr(1);
             }
         }
+
+        // The data body has been truncated
+        if (decompressed.size() != data_size)
+            return {};
     }
     return decompressed;
 }
 
-void HuffmanCompressor::compressFile(const std::string & inputFile, const std::string & outputFile)
+bool HuffmanCompressor::compressFile(const std::string & inputFile, const std::string & outputFile)
 {
     std::ifstream inFile(inputFile, std::ios::binary);
     std::ofstream outFile(outputFile, std::ios::binary | std::ios::trunc);
-
-    // Calculate char frequencies
-    FreqMap freqMap;
-    char ch;
-    while (inFile.get(ch)) {
-        freqMap[(HuffmanByte)ch]++;
-    }
-
-    // Build Huffman tree
-    HuffmanNode * root = buildHuffmanTree(freqMap);
-
-    // Generate encoding table
-    CodeMap huffmanCodes;
-    generateHuffmanCodes(root, "", huffmanCodes);
-
-    // Serialize tree structure
-    auto tree_data = serializeTree(root);
-
-    outFile << freqMap.size() << std::endl;
-    for (auto & pair : huffmanCodes) {
-        outFile << pair.first << " " << pair.second << std::endl;
-    }
-
-    // Reset the input file pointer
-    inFile.clear();
-    inFile.seekg(0);
-
-    // Compresse the data
-    std::stringstream compressedData;
-    while (inFile.get(ch)) {
-        compressedData << huffmanCodes[ch];
+    if (!inFile.is_open() || !outFile.is_open()) return false;
+
+    std::vector<HuffmanByte> block(kFileBlockSize);
+    while (inFile.good()) {
+        inFile.read(reinterpret_cast<char *>(block.data()), static_cast<std::streamsize>(kFileBlockSize));
+        std::size_t block_size = static_cast<std::size_t>(inFile.gcount());
+        if (block_size == 0) break;
+
+        // Compress the block
+        block.resize(block_size);
+        std::vector<HuffmanByte> compressed = compress(block);
+        block.resize(kFileBlockSize);
+
+        // Write the compressed block size and the compressed block
+        std::size_t compressed_size = compressed.size();
+        for (std::size_t i = 0; i < sizeof(std::uint32_t); ++i) {
+            outFile.put(static_cast<char>((compressed_size >> (i * 8)) & 0xFF));
+        }
+        outFile.write(reinterpret_cast<const char *>(compressed.data()),
+                      static_cast<std::streamsize>(compressed_size));
     }
-
-    // Write the compressed data to output file
-    std::string compressedStr = compressedData.str();
-    outFile << compressedStr;
+    bool success = !inFile.bad() && outFile.good();
 
     // Cleanup
     inFile.close();
     outFile.close();
-    if (root) {
-        delete root;
+    return success;
+}
+
+static inline std::size_t readUInt32(const HuffmanByte * input)
+{
+    std::size_t value = 0;
+    for (std::size_t i = 0; i < sizeof(std::uint32_t); ++i) {
+        value |= static_cast<std::size_t>(input[i]) << (i * 8);
     }
+    return value;
 }
 
-void HuffmanCompressor::decompressFile(const std::string & inputFile, const std::string & outputFile)
+bool HuffmanCompressor::decompressFile(const std::string & inputFile, const std::string & outputFile)
 {
     std::ifstream inFile(inputFile, std::ios::binary);
-    std::ofstream outFile(outputFile, std::ios::binary);
-
-    // Read the encode table
-    std::size_t size;
-    inFile >> size;
-
-    // ignore the NewLinw chars
-    inFile.ignore();
-
-    std::unordered_map<std::string, char> codeMap;
-    char ch;
-    std::string code;
-    for (std::size_t i = 0; i < size; ++i) {
-        inFile.get(ch);
-        std::getline(inFile, code);
-        codeMap[code] = ch;
-    }
+    std::ofstream outFile(outputFile, std::ios::binary | std::ios::trunc);
+    if (!inFile.is_open() || !outFile.is_open()) return false;
 
-    // Decompress the data
-    std::stringstream compressedData;
-    char bit;
-    while (inFile.get(bit)) {
-        compressedData << bit;
-    }
-    std::string compressedStr = compressedData.str();
-
-    // Decode data
-    std::string decodedStr;
-    std::string currentCode;
-    for (char bit : compressedStr) {
-        currentCode += bit;
-        if (codeMap.find(currentCode) != codeMap.end()) {
-            decodedStr += codeMap[currentCode];
-            currentCode.clear();
+    bool success = true;
+    std::vector<HuffmanByte> compressed;
+    while (inFile.good()) {
+        // Read the compressed block size
+        HuffmanByte size_bytes[sizeof(std::uint32_t)];
+        inFile.read(reinterpret_cast<char *>(size_bytes), sizeof(size_bytes));
+        if (inFile.gcount() == 0) break;
+        if (inFile.gcount() != static_cast<std::streamsize>(sizeof(size_bytes))) {
+            success = false;
+            break;
         }
-    }
 
-    // Write the decode data to output file
-    outFile << decodedStr;
+        // A block of the encoder is never larger than kMaxCompressedBlockSize
+        std::size_t compressed_size = readUInt32(size_bytes);
+        if ((compressed_size < sizeof(std::uint32_t)) || (compressed_size > kMaxCompressedBlockSize)) {
+            success = false;
+            break;
+        }
+
+        // Read and decompress the block
+        compressed.resize(compressed_size);
+        inFile.read(reinterpret_cast<char *>(compressed.data()), static_cast<std::streamsize>(compressed_size));
+        if (inFile.gcount() != static_cast<std::streamsize>(compressed_size)) {
+            success = false;
+            break;
+        }
+
+        // The data size of the block, a block holds kFileBlockSize bytes at most,
+        // and a failed decode returns less than the data size.
+        std::size_t data_size = readUInt32(compressed.data());
+        if (data_size > kFileBlockSize) {
+            success = false;
+            break;
+        }
+
+        std::vector<HuffmanByte> decompressed = decompress(compressed);
+        if (decompressed.size() != data_size) {
+            success = false;
+            break;
+        }
+
+        // Write the decode data to output file
+        outFile.write(reinterpret_cast<const char *>(decompressed.data()),
+                      static_cast<std::streamsize>(decompressed.size()));
+    }
+    if (!outFile.good())
+        success = false;
 
     // Cleanup
     inFile.close();
     outFile.close();
+    return success;
 }
 
 } // namespace zipstd
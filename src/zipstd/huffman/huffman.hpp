@@ -5,8 +5,7 @@
 #include <cstddef>
 #include <vector>
 #include <string>
-#include <queue>
-#include <unordered_map>
+#include <array>
 #include <memory>
 
 #include <assert.h>
@@ -23,20 +22,72 @@ public:
     HuffmanNode * left;
     HuffmanNode * right;
 
+    HuffmanNode() : data(0), freq(0), left(nullptr), right(nullptr) {}
     HuffmanNode(HuffmanByte data, std::uint32_t freq) : data(data), freq(freq), left(nullptr), right(nullptr) {}
 };
 
-struct HuffmanCompare
-{
-    inline bool operator () (HuffmanNode * a, HuffmanNode * b) {
-        return (a->freq > b->freq);
-    }
-};
-
 class HuffmanCompressor {
 public:
-    using FreqMap = std::unordered_map<HuffmanByte, std::uint32_t>;
-    using CodeMap = std::unordered_map<HuffmanByte, std::string>;
+    static constexpr std::size_t kMaxSymbols = 256;
+
+    using Histogram = std::array<std::uint32_t, kMaxSymbols>;
+
+    // A Huffman tree has at most 256 leaves and 255 internal nodes.
+    static constexpr std::size_t kMaxNodes = kMaxSymbols * 2 - 1;
+
+    // The longest code that can be stored in a HuffmanCode.
+    static constexpr std::size_t kMaxCodeLength = 32;
+
+    // The shortest length limit that can hold all 256 symbols.
+    static constexpr std::size_t kMinCodeLength = 8;
+
+    // The default length limit, the code lengths header can be packed into nibbles.
+    static constexpr std::size_t kDefaultCodeLength = 15;
+
+    // Canonical Huffman code, the code bits are stored in the low [length] bits.
+    struct HuffmanCode {
+        std::uint32_t code;
+        std::uint32_t length;
+    };
+
+    using CodeLengths = std::array<std::uint8_t, kMaxSymbols>;
+    using CodeTable   = std::array<HuffmanCode, kMaxSymbols>;
+
+    //
+    // The format of compress():
+    //
+    // [data size: 4 bytes][code lengths][data body]
+    //
+    // The data size is a little-endian 32-bit field, so the data must be smaller
+    // than 4 GB. A lone symbol has no data body.
+    //
+    static constexpr std::size_t kMaxDataSize = 0xFFFFFFFFu;
+
+    //
+    // The file format of compressFile(): a sequence of independent blocks,
+    // each block has its own code lengths header.
+    //
+    // [compressed block size: 4 bytes][compressed block: compress() output]
+    //
+    static constexpr std::size_t kFileBlockSize = 128 * 1024;
+
+    // The largest compressed block: each symbol takes kMaxCodeLength bits, plus the headers.
+    static constexpr std::size_t kMaxCompressedBlockSize = kFileBlockSize * kMaxCodeLength / 8 + 1024;
+
+    HuffmanCompressor(std::size_t max_code_length = kDefaultCodeLength) : node_count_(0) {
+        setMaxCodeLength(max_code_length);
+    }
+
+    std::size_t maxCodeLength() const { return max_code_length_; }
+
+    // Set the length limit of codes, it's clamped to [kMinCodeLength, kMaxCodeLength].
+    void setMaxCodeLength(std::size_t max_code_length) {
+        if (max_code_length < kMinCodeLength)
+            max_code_length = kMinCodeLength;
+        else if (max_code_length > kMaxCodeLength)
+            max_code_length = kMaxCodeLength;
+        max_code_length_ = max_code_length;
+    }
 
     // Compress data
     std::vector<HuffmanByte> compress(const std::vector<HuffmanByte> & data);
@@ -44,32 +95,66 @@ public:
     // Decompress data
     std::vector<HuffmanByte> decompress(const std::vector<HuffmanByte> & compressed_data);
 
-    // Compress file
-    void compressFile(const std::string& inputFile, const std::string & outputFile);
+    // Compress file, kFileBlockSize bytes at a time, return false if the files can't be read or written
+    bool compressFile(const std::string& inputFile, const std::string & outputFile);
 
-    // Decompress file
-    void decompressFile(const std::string& inputFile, const std::string & outputFile);
+    // Decompress file, return false if the files can't be read or written, or the data is invalid
+    bool decompressFile(const std::string& inputFile, const std::string & outputFile);
 
 private:
+    std::size_t max_code_length_;
+
+    //
+    // The nodes of the current Huffman tree, they are reused by the next tree.
+    // The leaves sorted by frequency are in [0, num_leaves), and the internal nodes
+    // are in [num_leaves, node_count_), the root is the last node.
+    //
+    std::array<HuffmanNode, kMaxNodes> node_pool_;
+    std::size_t node_count_;
+
     inline bool isLeaf(HuffmanNode * node) {
         assert(node != nullptr);
         return ((node->left == nullptr) && (node->right == nullptr));
     }
 
-    // Build Huffman tree
-    HuffmanNode * buildHuffmanTree(const FreqMap & freqMap);
+    HuffmanNode * newNode(HuffmanByte data, std::uint32_t freq) {
+        assert(node_count_ < kMaxNodes);
+        HuffmanNode * node = &node_pool_[node_count_++];
+        node->data  = data;
+        node->freq  = freq;
+        node->left  = nullptr;
+        node->right = nullptr;
+        return node;
+    }
+
+    // Count the frequencies of symbols
+    void buildHistogram(const HuffmanByte * data, std::size_t size, Histogram & histogram);
+
+    // Build Huffman tree with the two-queue method
+    HuffmanNode * buildHuffmanTree(const Histogram & histogram);
 
     // Build Huffman tree
     HuffmanNode * buildHuffmanTree(const std::vector<HuffmanByte> & data);
 
-    // Generate encoding table
-    void generateHuffmanCodes(HuffmanNode * node, const std::string & code, CodeMap & codes);
+    // Get the code lengths from the depth of leaves, return the max code length
+    std::size_t generateCodeLengths(HuffmanNode * node, std::size_t depth, CodeLengths & lengths);
+
+    // Build the code lengths, no longer than max_code_length_
+    void buildCodeLengths(HuffmanNode * root, CodeLengths & lengths);
+
+    // Build the optimal length-limited code lengths (package-merge)
+    void buildLimitedCodeLengths(const HuffmanNode * leaves, std::size_t num_leaves,
+                                 std::size_t max_length, CodeLengths & lengths);
+
+    // Assign canonical codes by the code lengths
+    void assignCanonicalCodes(const CodeLengths & lengths, CodeTable & codes);
 
-    // Serialize Huffman tree
-    std::vector<HuffmanByte> serializeTree(HuffmanNode * node);
+    // Write the code lengths header
+    void writeCodeLengths(const CodeLengths & lengths, std::vector<HuffmanByte> & output);
 
-    // Deserialize Huffman tree
-    HuffmanNode * deserializeTree(const std::vector<HuffmanByte> & tree_data, std::size_t & index);
+    // Read the code lengths header, return the max code length, or 0 if it's invalid
+    std::size_t readCodeLengths(const std::vector<HuffmanByte> & input, std::size_t & pos,
+                                CodeLengths & lengths);
 };
 
 } // namespace zipstd